@@ -1,8 +1,17 @@
+#include <cstring>
 #include <limits>
 #include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "global.h"
 #include "overlay.h"
+#include "motion.h"
+#include "pyramid.h"
+#include "video/convert.h"
 
 using namespace std;
 using novas0x2a::stringify;
@@ -39,10 +48,17 @@ void blue(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t heig
 }
 
 // 3-pixel horizontal blur
+void blur(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1)
+{
+    // The frame is one long row, so the ends of a row blur into the next
+    const uint32_t end = min(y1*width, height*width-1);
+    for (uint32_t i = max(y0*width, 1u); i < end; ++i)
+        out[i] = (in[i-1] + in[i] + in[i+1])/RGB(3,3,3);
+}
+
 void blur(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
 {
-    for (uint32_t y = 1; y < height*width-1; ++y)
-        out[y] = (in[y-1] + in[y] + in[y+1])/RGB(3,3,3);
+    blur(in, out, width, height, 0, height);
 }
 
 // Replace the blue channel with the average of the red and green.
@@ -122,32 +138,143 @@ void gray(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t heig
         out[i] = RGB(Vd(in[i]), Vd(in[i]), Vd(in[i]));
 }
 
+void gray(const byte *in, byte *out, const uint32_t width, const uint32_t height)
+{
+    bgra_to_gray8(reinterpret_cast<const Pixel*>(in), out, width*height);
+}
+
+void gray_gray8(const byte *in, byte *out, const uint32_t width, const uint32_t height)
+{
+    memcpy(out, in, width*height);
+}
+
 // (Vertical) Edge-detection
-void edge(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
+void edge(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1)
 {
     double val;
-    for (uint32_t i = 1; i < width*height-1; ++i)
+    const uint32_t end = min(y1*width, width*height-1);
+    for (uint32_t i = max(y0*width, 1u); i < end; ++i)
     {
         val = fabs(-Vd(in[i-1]) + Vd(in[i+1]))/2;
         out[i] = val > 15 ? RGB(0xff,0xff,0xff) : RGB(0,0,0);
     }
 }
 
+void edge(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
+{
+    edge(in, out, width, height, 0, height);
+}
+
+void edge(const byte *in, byte *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1)
+{
+    const uint32_t end = min(y1*width, width*height-1);
+    uint32_t i = max(y0*width, 1u);
+#ifdef __SSE2__
+    // |in[i+1] - in[i-1]| > 30, sixteen at a time
+    const __m128i limit = _mm_set1_epi8(30), zero = _mm_setzero_si128(), ones = _mm_set1_epi8(-1);
+    for (; i + 16 <= end; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i - 1));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 1));
+        const __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        const __m128i quiet = _mm_cmpeq_epi8(_mm_subs_epu8(d, limit), zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(quiet, ones));
+    }
+#endif
+    for (; i < end; ++i)
+        out[i] = abs(int32_t(in[i+1]) - in[i-1]) > 30 ? 0xff : 0;
+}
+
+void edge(const byte *in, byte *out, const uint32_t width, const uint32_t height)
+{
+    edge(in, out, width, height, 0, height);
+}
+
+namespace
+{
+    // |gx| + |gy| around p, from 0 to 2040
+    inline uint32_t sobel(const byte *p, const int32_t w)
+    {
+        const int32_t gx = (p[-w+1] + 2*p[1] + p[w+1]) - (p[-w-1] + 2*p[-1] + p[w-1]);
+        const int32_t gy = (p[w-1] + 2*p[w] + p[w+1]) - (p[-w-1] + 2*p[-w] + p[-w+1]);
+        return abs(gx) + abs(gy);
+    }
+}
+
+// Gradient magnitude. The outermost rows and columns stay black.
+void gradient(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1)
+{
+    // Gray for the band, and the row either side of it
+    const uint32_t g0 = y0 ? y0 - 1 : 0, g1 = min(y1 + 1, height);
+    vector<byte> g(width*(g1 - g0));
+    bgra_to_gray8(in + g0*width, &g[0], width*(g1 - g0));
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        Pixel *row = out + y*width;
+        if (y == 0 || y + 1 >= height)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+                row[x] = RGB(0, 0, 0);
+            continue;
+        }
+        row[0] = row[width-1] = RGB(0, 0, 0);
+        for (uint32_t x = 1; x + 1 < width; ++x)
+        {
+            const uint32_t m = min<uint32_t>(sobel(&g[(y - g0)*width + x], width) / 8, 0xff);
+            row[x] = RGB(m, m, m);
+        }
+    }
+}
+
+void gradient(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
+{
+    gradient(in, out, width, height, 0, height);
+}
+
+void gradient(const byte *in, byte *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1)
+{
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        uint16_t *row = reinterpret_cast<uint16_t*>(out) + y*width;
+        if (y == 0 || y + 1 >= height)
+        {
+            memset(row, 0, width*sizeof(uint16_t));
+            continue;
+        }
+        row[0] = row[width-1] = 0;
+        for (uint32_t x = 1; x + 1 < width; ++x)
+            row[x] = sobel(in + y*width + x, width) * 32;
+    }
+}
+
+void gradient(const byte *in, byte *out, const uint32_t width, const uint32_t height)
+{
+    gradient(in, out, width, height, 0, height);
+}
+
 // Crazy color effects
-void colorize(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
+static const Pixel* pick_colors(void)
 {
     static Pixel color[5];
+    srand(time(NULL));
+    for (uint32_t i = 0; i < 5; ++i)
+        color[i] = RGB(rand() % 255, rand() % 255, rand() % 255);
+    return color;
+}
+
+static const Pixel* colorize_colors(void)
+{
+    // Picked on the first call (which the compiler guards, should two
+    // threads make it at once)
+    static const Pixel *color = pick_colors();
+    return color;
+}
+
+void colorize(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
+{
+    const Pixel *color = colorize_colors();
     int32_t idx = 0;
-    static bool done = 0;
     bool chg, last = false;
-    // Cache the colors on the first call
-    if (!done)
-    {
-        srand(time(NULL));
-        for (uint32_t i = 0; i < 5; ++i)
-            color[i] = RGB(rand() % 255, rand() % 255, rand() % 255);
-        done++;
-    }
 
     for (uint32_t y = 0; y < height; ++y)
     {
@@ -163,6 +290,60 @@ void colorize(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t
     }
 }
 
+void colorize(const byte *in, byte *out, const uint32_t width, const uint32_t height)
+{
+    const Pixel *color = colorize_colors();
+    Pixel *o = reinterpret_cast<Pixel*>(out);
+    int32_t idx = 0;
+    bool chg, last = false;
+
+    for (uint32_t i = 0; i < width*height; ++i)
+    {
+        if (i % width == 0)
+            idx = 0;
+        chg = in[i];
+        if (last ^ chg)
+            idx = (idx + 1) % 5;
+        o[i] = color[idx];
+        last = chg;
+    }
+}
+
+// Motion detection. Only the blocks that changed since the last frame are
+// copied through, so the output holds still while the scene does.
+void motion(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
+{
+    MotionDetector &d = slot_motion();
+    d.update(in, width, height);
+    d.copyChanged(in, out);
+}
+
+// Levels 1 and up of the input's pyramid: the first on the left, and the
+// rest stacked down the right
+void pyramid(const Pixel *, Pixel *out, const uint32_t width, const uint32_t height)
+{
+    Pyramid &p = input_pyramid();
+    memset(out, 0, width * height * sizeof(Pixel));
+    uint32_t x = 0, y = 0;
+    for (uint32_t k = 1; k < p.levels(); ++k)
+    {
+        const uint32_t w = p.getWidth(k), h = p.getHeight(k);
+        const byte *level = p.level(k);
+        for (uint32_t row = 0; row < h; ++row)
+        {
+            Pixel *o = out + (y + row)*width + x;
+            if (p.getFormat() == FORMAT_BGRA32)
+                memcpy(o, level + row*w*sizeof(Pixel), w*sizeof(Pixel));
+            else
+                gray8_to_bgra(level + row*w, o, w);
+        }
+        if (k == 1)
+            x = w;
+        else
+            y += h;
+    }
+}
+
 #if 0
 void edge2(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
 {
@@ -7,6 +7,7 @@
 #include <algorithm>
 
 #include "global.h"
+#include "motion.h"
 
 // Identity
 void copy(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
@@ -22,6 +23,8 @@ void blue(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t heig
 
 // 3-Pixel Radius Blur
 void blur(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
+// ... rows [y0, y1) of it
+void blur(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1);
 
 // Replace the blue channel with the average of the red and green.
 // This makes the blue channel noise less obvious
@@ -41,12 +44,35 @@ void frame_counter(const Pixel *in, Pixel *out, const uint32_t width, const uint
 
 // Greyscale (NTSC)
 void gray(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
+// ... from BGRA to one byte a pixel
+void gray(const byte *in, byte *out, const uint32_t width, const uint32_t height);
+// ... of what's already 8-bit gray, which is a copy
+void gray_gray8(const byte *in, byte *out, const uint32_t width, const uint32_t height);
 
 // Edge-detection
 void edge(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
+void edge(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1);
+// ... on 8-bit gray
+void edge(const byte *in, byte *out, const uint32_t width, const uint32_t height);
+void edge(const byte *in, byte *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1);
+
+// Gradient magnitude (Sobel)
+void gradient(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
+void gradient(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1);
+// ... from 8-bit gray to 16-bit gray, which has room for the whole range
+void gradient(const byte *in, byte *out, const uint32_t width, const uint32_t height);
+void gradient(const byte *in, byte *out, const uint32_t width, const uint32_t height, const uint32_t y0, const uint32_t y1);
 
 // Crazy color effects
 void colorize(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
+// ... from 8-bit gray to BGRA
+void colorize(const byte *in, byte *out, const uint32_t width, const uint32_t height);
+
+// Motion detection. Only the 16x16 blocks that changed are copied through.
+void motion(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
+
+// The input's image pyramid, each level beside the last
+void pyramid(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
 
 #if 0
 void edge2(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
@@ -7,6 +7,12 @@
 #define likely(x)       __builtin_expect((x),1)
 #define unlikely(x)     __builtin_expect((x),0)
 
+// gcc can build single functions for instruction sets beyond the target's
+// (__attribute__((target(...)))), and check for them at runtime
+#if (defined(__i386__) || defined(__x86_64__)) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_CPU_DISPATCH 1
+#endif
+
 // The attribute makes it so gcc makes better assumptions about optimization
 typedef unsigned char byte;
 typedef byte Pixel __attribute__((vector_size (4)));
@@ -0,0 +1,146 @@
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "graph.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    bool parse_bool(const string &value, const string &where)
+    {
+        if (value == "yes" || value == "1" || value == "true")
+            return true;
+        if (value == "no" || value == "0" || value == "false")
+            return false;
+        throw GraphError(where + ": expected yes or no, not \"" + value + "\"");
+    }
+
+    void set_flag(GraphNode &n, uint32_t flag, bool on)
+    {
+        if (on)
+        {
+            n.info.flags |= flag;
+            n.forced     |= flag;
+            n.cleared    &= ~flag;
+        }
+        else
+        {
+            n.info.flags &= ~flag;
+            n.cleared    |= flag;
+            n.forced     &= ~flag;
+        }
+    }
+}
+
+GraphFile::GraphFile(const char *path) : path(path), mtime(0), size(0)
+{
+    Context c(string("When opening graph file ") + path);
+    load();
+}
+
+void GraphFile::load(void)
+{
+    Context c("When loading graph file " + path);
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0)
+        throw GraphError("Couldn't stat " + path + ": " + strerror(errno));
+
+    // Remember this version even if it's broken, so it's only complained about once
+    mtime = st.st_mtime;
+    size  = st.st_size;
+
+    ifstream f(path.c_str());
+    if (!f)
+        throw GraphError("Couldn't open " + path + ": " + strerror(errno));
+
+    // Only replace the graph once the whole file parsed
+    nodes = parse(f, path);
+}
+
+bool GraphFile::modified(void) const
+{
+    struct stat st;
+    // A file that's gone missing (editors do that while saving) hasn't changed yet
+    if (stat(path.c_str(), &st) < 0)
+        return false;
+    return st.st_mtime != mtime || st.st_size != size;
+}
+
+vector<GraphNode> GraphFile::parse(istream &in, const string &where)
+{
+    vector<GraphNode> ret;
+    string line;
+
+    for (uint32_t lineno = 1; getline(in, line); ++lineno)
+    {
+        const string here = where + ":" + stringify(lineno);
+
+        string::size_type hash = line.find('#');
+        if (hash != string::npos)
+            line.erase(hash);
+
+        istringstream words(line);
+        GraphNode n;
+        if (!(words >> n.slot))
+        {
+            if (words.eof())
+                continue; // blank line
+            throw GraphError(here + ": expected a slot number");
+        }
+        if (!(words >> n.name))
+            throw GraphError(here + ": expected a filter name");
+        if (!(words >> n.src))
+            throw GraphError(here + ": expected a source slot");
+
+        try {
+            n.info = FilterRegistry::get().find(n.name);
+        } catch (const ArgumentError &e) {
+            throw GraphError(here + ": " + e.message());
+        }
+
+        string param;
+        while (words >> param)
+        {
+            string::size_type eq = param.find('=');
+            if (eq == string::npos)
+                throw GraphError(here + ": expected key=value, not \"" + param + "\"");
+            const string key = param.substr(0, eq), value = param.substr(eq+1);
+
+            if (key == "output")
+                n.output = parse_bool(value, here);
+            else if (key == "volatile")
+                set_flag(n, FILTER_VOLATILE, parse_bool(value, here));
+            else if (key == "pointwise")
+                set_flag(n, FILTER_POINTWISE, parse_bool(value, here));
+            else if (key == "scalable")
+                set_flag(n, FILTER_SCALABLE, parse_bool(value, here));
+            else if (key == "serial")
+                set_flag(n, FILTER_SERIAL, parse_bool(value, here));
+            else if (key == "priority")
+            {
+                try {
+                    n.priority = priorityByName(value);
+                } catch (const ArgumentError &e) {
+                    throw GraphError(here + ": " + e.message());
+                }
+            }
+            else if (find(n.info.params.begin(), n.info.params.end(), key) != n.info.params.end())
+                n.params.push_back(make_pair(key, value));
+            else
+                throw GraphError(here + ": unknown parameter \"" + key + "\"");
+        }
+
+        ret.push_back(n);
+    }
+    return ret;
+}
@@ -0,0 +1,89 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <ctime>
+
+#include "global.h"
+#include "registry.h"
+#include "qos.h"
+
+// One filter in a graph description
+struct GraphNode {
+    GraphNode() : slot(0), src(0), forced(0), cleared(0), output(true), priority(PRIORITY_NORMAL) {};
+    // Where the filter goes, and where it reads from
+    uint32_t slot, src;
+    // Registry name
+    std::string name;
+    // Function and flags, after parameters are applied
+    FilterInfo info;
+    // FILTER_* properties the line turned on and off (already in info.flags)
+    uint32_t forced, cleared;
+    // Whether the slot is an output (see Window::SetOutput)
+    bool output;
+    // What goes first when frames run late (see Window::SetPriority)
+    Priority priority;
+    // Filter-specific parameters (see FilterInfo::params), in file order
+    FilterParams params;
+};
+
+// A filter graph read from a text file. Each line looks like
+//     <slot> <filter name> <source slot> [key=value ...]
+// and '#' starts a comment. The parameters are
+//     output=yes|no      is the slot an output (default yes)
+//     volatile=yes|no    override FILTER_VOLATILE
+//     pointwise=yes|no   override FILTER_POINTWISE
+//     scalable=yes|no    override FILTER_SCALABLE
+//     serial=yes|no      override FILTER_SERIAL
+//     priority=low|normal|high|critical
+//                        what gets cut back first when frames run late
+//                        (default normal)
+// plus whatever the filter itself takes (see FilterInfo::params). Those
+// belong to the line, so two lines can run a filter with different values.
+class GraphFile
+{
+    public:
+        /**
+         * Read a graph file
+         * @param path  Path to the file
+         */
+        explicit GraphFile(const char *path);
+
+        /**
+         * Read the file again. If it's broken, throws and keeps the last
+         * good graph.
+         */
+        void load(void);
+
+        /** Whether the file changed since it was last loaded */
+        bool modified(void) const;
+
+        inline const std::vector<GraphNode>& getNodes(void) const {return nodes;};
+        inline const std::string& getPath(void) const {return path;};
+
+        /**
+         * Parse a graph description
+         * @param in    Where to read it from
+         * @param where What to call it in error messages
+         * @return      The filters, in the order they were listed
+         */
+        static std::vector<GraphNode> parse(std::istream &in, const std::string &where);
+
+    private:
+        const std::string path;
+        std::vector<GraphNode> nodes;
+        // When the file was loaded, to notice edits
+        time_t mtime;
+        off_t size;
+};
+
+class GraphError : public novas0x2a::Exception
+{
+    public:
+        GraphError(const std::string& our_message) throw ():
+            Exception(our_message) {};
+};
+
+#endif
@@ -3,61 +3,207 @@
 #include <limits>
 #include <algorithm>
 #include <memory>
+#include <sstream>
+#include <vector>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <getopt.h>
 
 #include "global.h"
 #include "window.h"
-#include "filters.h"
+#include "graph.h"
+#include "pluginloader.h"
 
 #include "video/v4l.h"
 #include "video/staticfile.h"
+#include "video/playback.h"
+#include "video/capture.h"
+#include "video/replay.h"
+#include "video/pattern.h"
+#include "video/shmsource.h"
 
 using namespace std;
 using namespace novas0x2a;
 
+// The graph to use when none is given. See graph.h for the format.
+static const char default_graph[] =
+    "1  linear_contrast 0            # Brightness\n"
+    "2  rgb_hist        1\n"
+    "3  invert          1\n"
+    "4  frame_counter   1\n"
+    "5  gray            1\n"
+    "6  edge            5\n"
+    "7  colorize        6\n"
+    "8  red             1\n"
+    "9  green           1\n"
+    "10 blue            1\n"
+    "12 invert          8            # Cyan\n"
+    "13 invert          9            # Magenta\n"
+    "14 invert          10           # Yellow\n";
+
+#define USAGE "Usage: glasses [-p plugin dir] [-r fps] [-f pixel format] [-c capture WxH] [-s processing WxH] [-t tile WxH] [-m area|bilinear|lanczos] [-o ppm|png] [-R recording] [-S slot to record] [-C capture.cap] [-z] [-u] [-P slot,...] [-T processing fps] [-F display hz] [-B filter ms] [-j threads] [-A] <v4l device, ppm file, recording, capture, shm:/ring or pattern:bars|gradient|noise|shapes> [graph file]"
+
+// Parse a WxH size for option opt
+static void parseSize(const char *arg, char opt, uint32_t &width, uint32_t &height)
+{
+    char *end;
+    width = strtoul(arg, &end, 10);
+    if (*end == 'x')
+        height = strtoul(end + 1, &end, 10);
+    if (*end || width == 0 || height == 0)
+        throw CommandLineError(string("-") + opt + " wants a size like 640x480, not " + arg);
+}
+
 int main(int argc, char *argv[])
 {
     try {
         Context c("When running " PROGRAM " " VERSION);
-        if (argc != 2)
-            throw CommandLineError("Usage: glasses <v4l device or ppm file>");
+        const char *plugin_dir = NULL;
+        double fps = 0;
+        // What to ask the camera for. Anything else gets converted.
+        PixelFormat format = FORMAT_BGRA32;
+        // The size the filters work at, what to ask the camera for (0: the
+        // same), the size of the tiles on the screen (0: the same as the
+        // filters), and how to get from the camera's size to the filters'
+        uint32_t width = 176, height = 144, capture_w = 0, capture_h = 0, tile_w = 0, tile_h = 0;
+        ResampleMethod method = RESAMPLE_AREA;
+        SnapshotFormat shots = SNAPSHOT_PPM;
+        // What the r key records: the screen (-1) or a slot, and where to
+        const char *record = "rec.y4m";
+        int32_t record_slot = -1;
+        // Where to capture the source to, whether to compress it, and
+        // whether captures replay as fast as they can rather than at their
+        // own pace
+        const char *capture = NULL;
+        bool compress = false, unthrottled = false;
+        // Slots to publish to other processes
+        vector<uint32_t> publish;
+        // How many frames to process a second (0: as many as the source
+        // gives), and how often to redraw the screen
+        double process_hz = 0, display_hz = 60;
+        // Time the filters get per frame before the least important are cut
+        // back (0: none, -1: whatever -T leaves)
+        double budget = -1;
+        // Threads to run filters on (0: one per core), and whether to tie
+        // each to a core
+        uint32_t threads = 0;
+        bool pin = false;
+        int opt;
+        while ((opt = getopt(argc, argv, "p:r:f:c:s:t:m:o:R:S:C:zuP:T:F:B:j:A")) != -1)
+        {
+            switch (opt)
+            {
+                case 'p': plugin_dir = optarg;          break;
+                case 'r': fps = strtod(optarg, 0);      break;
+                case 'f': format = formatByName(optarg); break;
+                case 'c': parseSize(optarg, opt, capture_w, capture_h); break;
+                case 's': parseSize(optarg, opt, width, height);        break;
+                case 't': parseSize(optarg, opt, tile_w, tile_h);       break;
+                case 'm': method = resampleByName(optarg);              break;
+                case 'o': shots = snapshotByName(optarg);               break;
+                case 'R': record = optarg;                              break;
+                case 'S': record_slot = strtol(optarg, 0, 10);          break;
+                case 'C': capture = optarg;                             break;
+                case 'z': compress = true;                              break;
+                case 'u': unthrottled = true;                           break;
+                case 'T': process_hz = strtod(optarg, 0);               break;
+                case 'F': display_hz = strtod(optarg, 0);               break;
+                case 'B': budget = strtod(optarg, 0);                   break;
+                case 'j': threads = strtoul(optarg, 0, 10);             break;
+                case 'A': pin = true;                                   break;
+                case 'P':
+                    for (char *p = optarg; *p; )
+                    {
+                        publish.push_back(strtoul(p, &p, 10));
+                        if (*p == ',')
+                            ++p;
+                        else if (*p)
+                            throw CommandLineError(string("-P wants slot numbers like 3,7, not ") + optarg);
+                    }
+                    break;
+                default:  throw CommandLineError(USAGE);
+            }
+        }
+        argc -= optind;
+        argv += optind;
+        if (argc != 1 && argc != 2)
+            throw CommandLineError(USAGE);
 
-        struct stat st;
-        if (stat(argv[1], &st) < 0)
-            throw CommandLineError(string("Couldn't stat file: ") + strerror(errno));
+        // Before anything starts the pool
+        TaskPool::configure(threads, pin);
+
+        // Plugins go in the registry before anything looks filters up
+        auto_ptr<PluginLoader> plugins;
+        if (plugin_dir)
+            plugins = auto_ptr<PluginLoader>(new PluginLoader(plugin_dir));
 
-        // If it's a regular file, create a static file. If it's a character
+        // Patterns, rings and recordings go by their names. Otherwise, if
+        // it's a regular file, create a static file. If it's a character
         // device, assume it's a V4L1 camera.
         auto_ptr<VideoDevice> v;
-        if (S_ISREG(st.st_mode))
-            v = auto_ptr<VideoDevice>(new StaticFile(argv[1]));
+        struct stat st;
+        if (Pattern::handles(argv[0]))
+            v = auto_ptr<VideoDevice>(new Pattern(argv[0], fps));
+        else if (SharedSource::handles(argv[0]))
+            v = auto_ptr<VideoDevice>(new SharedSource(argv[0]));
+        else if (Replay::handles(argv[0]))
+            v = auto_ptr<VideoDevice>(new Replay(argv[0], !unthrottled));
+        else if (Playback::handles(argv[0]))
+            v = auto_ptr<VideoDevice>(new Playback(argv[0], fps));
+        else if (stat(argv[0], &st) < 0)
+            throw CommandLineError(string("Couldn't stat file: ") + strerror(errno));
+        else if (S_ISREG(st.st_mode))
+            v = auto_ptr<VideoDevice>(new StaticFile(argv[0]));
         else if(S_ISCHR(st.st_mode))
-            v = auto_ptr<VideoDevice>(new V4LDevice(argv[1]));
+            v = auto_ptr<VideoDevice>(new V4LDevice(argv[0]));
+        else
+            throw CommandLineError(USAGE);
+
+        // Files and recordings keep their own size whatever is asked for.
+        // Patterns are made at whatever size is asked for.
+        v->setParams(capture_w ? capture_w : width, capture_h ? capture_h : height, format);
+
+        // Everything the source hands over goes into the capture too. The
+        // tee is finished before the source goes, and the window before both.
+        auto_ptr<VideoDevice> tee;
+        if (capture)
+            tee = auto_ptr<VideoDevice>(new CaptureTee(*v, capture, compress));
+        VideoDevice &source = tee.get() ? *tee : *v;
+
+        vector<GraphNode> nodes;
+        auto_ptr<GraphFile> graph;
+        if (argc == 2)
+        {
+            graph = auto_ptr<GraphFile>(new GraphFile(argv[1]));
+            nodes = graph->getNodes();
+        }
         else
-            throw CommandLineError("Usage: glasses <v4l device or ppm file>");
-
-        //TODO: Tied to SDL pixel format definitions
-        v->setParams(176, 144, 32, VIDEO_PALETTE_RGB32);
-
-        Window win(*v, 14);
-
-        win.AddFilter("Brightness",      linear_contrast, 1, 0);
-        win.AddFilter("RGB Histogram",   rgb_hist,        2, 1);
-        win.AddFilter("Inverter",        invert,          3, 1);
-        win.AddFilter("Counter",         frame_counter,   4, 1);
-        win.AddFilter("Grayscale",       gray,            5, 1);
-        win.AddFilter("Edge detect",     edge,            6, 5);
-        win.AddFilter("Colorize",        colorize,        7, 6);
-
-        win.AddFilter("Red Channel",     red,             8, 1);
-        win.AddFilter("Green Channel",   green,           9, 1);
-        win.AddFilter("Blue Channel",    blue,           10, 1);
-        win.AddFilter("Cyan Channel",    invert,         12, 8);
-        win.AddFilter("Magenta Channel", invert,         13, 9);
-        win.AddFilter("Yellow Channel",  invert,         14, 10);
+        {
+            istringstream in(default_graph);
+            nodes = GraphFile::parse(in, "default graph");
+        }
+
+        // The grid is sized for the graph we start with
+        uint32_t windows = 1;
+        for (vector<GraphNode>::const_iterator i = nodes.begin(); i != nodes.end(); ++i)
+            windows = max(windows, i->slot);
+
+        Window win(source, windows, width, height, tile_w, tile_h, method);
+        win.SetShotFormat(shots);
+        win.SetPacing(process_hz, display_hz);
+        if (budget < 0)
+            budget = process_hz > 0 ? 1000 / process_hz : 0;
+        win.SetBudget(budget);
+        win.SetRecording(record, record_slot, fps > 0 ? fps : 30);
+        for (vector<uint32_t>::const_iterator i = publish.begin(); i != publish.end(); ++i)
+            win.Publish(*i);
+        win.SetGraph(nodes);
+        if (graph.get())
+            win.WatchGraph(graph.get());
+        if (plugins.get())
+            win.WatchPlugins(plugins.get());
 
         win.MainLoop();
 
@@ -0,0 +1,159 @@
+#include <cstring>
+#include <cstdlib>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "motion.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    // Each thread runs its own filter
+    __thread MotionDetector **current = NULL;
+}
+
+MotionDetector& slot_motion(void)
+{
+    if (!current)
+        throw GeneralError(DEBUG_HERE, "There's no slot to detect motion for outside a filter");
+    if (!*current)
+        *current = new MotionDetector;
+    return **current;
+}
+
+void set_slot_motion(MotionDetector **slot)
+{
+    current = slot;
+}
+
+void BlockMap::reset(uint32_t width, uint32_t height, uint32_t block)
+{
+    this->width  = width;
+    this->height = height;
+    this->block  = block;
+    cols  = (width  + block - 1) / block;
+    rows  = (height + block - 1) / block;
+    count = 0;
+    flags.assign(cols*rows, 0);
+}
+
+void BlockMap::fill(void)
+{
+    flags.assign(cols*rows, 1);
+    count = cols*rows;
+}
+
+Rect BlockMap::blockRect(uint32_t bx, uint32_t by) const
+{
+    uint32_t x = bx*block, y = by*block;
+    return Rect(x, y, min(block, width - x), min(block, height - y));
+}
+
+Region BlockMap::region(void) const
+{
+    Region r;
+    for (uint32_t by = 0; by < rows; ++by)
+        for (uint32_t bx = 0; bx < cols; ++bx)
+            if (changed(bx, by))
+                r.add(blockRect(bx, by));
+    return r;
+}
+
+MotionDetector::MotionDetector(uint32_t block, uint32_t threshold)
+    : block(block), threshold(threshold), width(0), height(0), ref(NULL)
+{
+    Context c("When creating a MotionDetector");
+    if (block != 8 && block != 16)
+        throw ArgumentError("Motion blocks must be 8 or 16 pixels on a side, not " + stringify(block));
+}
+
+MotionDetector::~MotionDetector()
+{
+    delete [] ref;
+}
+
+uint32_t MotionDetector::update(const Pixel *in, uint32_t width, uint32_t height)
+{
+    if (unlikely(!ref || width != this->width || height != this->height))
+    {
+        delete [] ref;
+        ref = new Pixel[width*height];
+        memcpy(ref, in, width*height*sizeof(Pixel));
+        this->width  = width;
+        this->height = height;
+        map.reset(width, height, block);
+        map.fill();
+        return map.getChanged();
+    }
+
+    map.reset(width, height, block);
+    for (uint32_t by = 0; by < map.getRows(); ++by)
+        for (uint32_t bx = 0; bx < map.getCols(); ++bx)
+            if (blockChanged(in, bx, by))
+            {
+                map.set(bx, by);
+                copyBlock(in, ref, bx, by);
+            }
+    return map.getChanged();
+}
+
+void MotionDetector::copyChanged(const Pixel *in, Pixel *out) const
+{
+    for (uint32_t by = 0; by < map.getRows(); ++by)
+        for (uint32_t bx = 0; bx < map.getCols(); ++bx)
+            if (map.changed(bx, by))
+                copyBlock(in, out, bx, by);
+}
+
+void MotionDetector::copyBlock(const Pixel *in, Pixel *out, uint32_t bx, uint32_t by) const
+{
+    Rect r = map.blockRect(bx, by);
+    for (uint32_t y = r.y; y < r.y + r.h; ++y)
+        memcpy(out + y*width + r.x, in + y*width + r.x, r.w*sizeof(Pixel));
+}
+
+// The alpha channel is ignored, and a block is abandoned as soon as one of its
+// rows pushes the running sum past the limit.
+bool MotionDetector::blockChanged(const Pixel *in, uint32_t bx, uint32_t by) const
+{
+    const Rect r = map.blockRect(bx, by);
+    const uint32_t limit = threshold * r.w * r.h * 3;
+    uint32_t sad = 0;
+
+#ifdef __SSE2__
+    if (likely(r.w == block))
+    {
+        const __m128i mask = _mm_set1_epi32(0x00ffffff);
+        for (uint32_t y = r.y; y < r.y + r.h; ++y)
+        {
+            const __m128i *a = reinterpret_cast<const __m128i*>(in  + y*width + r.x);
+            const __m128i *b = reinterpret_cast<const __m128i*>(ref + y*width + r.x);
+            __m128i acc = _mm_setzero_si128();
+            // 4 pixels per register
+            for (uint32_t i = 0; i < block/4; ++i)
+                acc = _mm_add_epi64(acc, _mm_sad_epu8(
+                            _mm_and_si128(_mm_loadu_si128(a+i), mask),
+                            _mm_and_si128(_mm_loadu_si128(b+i), mask)));
+            sad += _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+            if (sad > limit)
+                return true;
+        }
+        return false;
+    }
+#endif
+
+    for (uint32_t y = r.y; y < r.y + r.h; ++y)
+    {
+        const Pixel *a = in  + y*width + r.x;
+        const Pixel *b = ref + y*width + r.x;
+        for (uint32_t x = 0; x < r.w; ++x)
+            sad += abs(R(a[x]) - R(b[x])) + abs(G(a[x]) - G(b[x])) + abs(B(a[x]) - B(b[x]));
+        if (sad > limit)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,111 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <vector>
+
+#include "global.h"
+#include "region.h"
+
+// Per-block change flags for one frame
+class BlockMap
+{
+    public:
+        BlockMap() : width(0), height(0), block(0), cols(0), rows(0), count(0) {};
+
+        /**
+         * Resize the map and mark every block unchanged
+         * @param width     frame width in pixels
+         * @param height    frame height in pixels
+         * @param block     block edge length in pixels
+         */
+        void reset(uint32_t width, uint32_t height, uint32_t block);
+
+        /** Mark every block as changed */
+        void fill(void);
+
+        inline void set(uint32_t bx, uint32_t by)
+        {
+            byte &f = flags[by*cols + bx];
+            count += !f;
+            f = 1;
+        };
+        inline bool changed(uint32_t bx, uint32_t by) const {return flags[by*cols + bx];};
+
+        /** The pixels covered by a block, clipped to the frame */
+        Rect blockRect(uint32_t bx, uint32_t by) const;
+
+        /** The changed blocks as a region (one rect per horizontal run) */
+        Region region(void) const;
+
+        inline uint32_t getCols(void)    const {return cols;};
+        inline uint32_t getRows(void)    const {return rows;};
+        inline uint32_t getBlock(void)   const {return block;};
+        inline uint32_t getChanged(void) const {return count;};
+        inline bool     any(void)        const {return count != 0;};
+
+    private:
+        uint32_t width, height, block, cols, rows, count;
+        std::vector<byte> flags;
+};
+
+// Compares each frame against a reference in fixed-size blocks using the sum
+// of absolute differences. Only blocks that changed are copied into the
+// reference, so slow drift still adds up to a change eventually.
+class MotionDetector
+{
+    public:
+        /**
+         * @param block     block edge length in pixels (8 or 16)
+         * @param threshold mean absolute difference per color channel above
+         *                  which a block counts as changed
+         */
+        explicit MotionDetector(uint32_t block = 16, uint32_t threshold = 8);
+        ~MotionDetector();
+
+        /**
+         * Compare a frame against the reference. The first frame (and any
+         * frame after a size change) marks every block changed.
+         * @param in        the new frame
+         * @param width     width in pixels
+         * @param height    height in pixels
+         * @return          the number of blocks that changed
+         */
+        uint32_t update(const Pixel *in, uint32_t width, uint32_t height);
+
+        /** The blocks that changed on the last update */
+        inline const BlockMap& changed(void) const {return map;};
+
+        /**
+         * Copy only the changed blocks from in to out
+         * @param in    frame passed to the last update
+         * @param out   frame of the same size
+         */
+        void copyChanged(const Pixel *in, Pixel *out) const;
+
+    private:
+        bool blockChanged(const Pixel *in, uint32_t bx, uint32_t by) const;
+        void copyBlock(const Pixel *in, Pixel *out, uint32_t bx, uint32_t by) const;
+
+        uint32_t block, threshold;
+        uint32_t width, height;
+        Pixel *ref;
+        BlockMap map;
+
+        explicit MotionDetector(const MotionDetector&);
+        MotionDetector& operator=(const MotionDetector&);
+};
+
+/**
+ * For filters: the detector of the slot being run, made on first use. Each
+ * slot compares against its own reference.
+ * @throw GeneralError outside a filter
+ */
+MotionDetector& slot_motion(void);
+
+/**
+ * For the window: say where the slot being run on this thread keeps its
+ * detector (NULL: nowhere). The slot owns whatever slot_motion makes there.
+ */
+void set_slot_motion(MotionDetector **slot);
+
+#endif
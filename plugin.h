@@ -0,0 +1,55 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+// The interface for filters that live in shared objects. A plugin exports
+//     extern "C" const GlassesPlugin* glasses_plugin(void);
+// which describes the filters in it. See plugins/threshold.cc for an example.
+
+#include "global.h"
+#include "registry.h"
+
+// Bump when the structures below change
+#define GLASSES_PLUGIN_ABI 1
+#define GLASSES_PLUGIN_ENTRY "glasses_plugin"
+
+// A filter parameter, settable from a graph file with key=value
+struct PluginParam {
+    const char *name;
+    // Description of the value (range, units, default)
+    const char *help;
+};
+
+// One filter in a plugin. Its functions are given the settings of the slot
+// they're running in (NULL if config_size is 0), so two graph lines can use
+// the filter with different parameters.
+struct PluginFilter {
+    // Name in the FilterRegistry
+    const char *name;
+    // Plain version, which has to work everywhere
+    ConfigFilterFunc f;
+    // FILTER_* properties
+    uint32_t flags;
+    // Parameters, ending with one whose name is NULL. May be NULL.
+    const PluginParam *params;
+    // Bytes of settings each slot gets. They're zeroed, then given to
+    // defaults (which may be NULL), then to set with each parameter from
+    // the graph line; set returns 0 on success, and may be NULL if there
+    // are no parameters. They're made again from the graph line after the
+    // plugin is reloaded, so their layout can change between versions.
+    size_t config_size;
+    ConfigDefaults defaults;
+    ConfigSetter set;
+    // Faster versions, used when the CPU has them. May be NULL.
+    ConfigFilterFunc sse2, avx2;
+};
+
+struct GlassesPlugin {
+    // GLASSES_PLUGIN_ABI, as the plugin was built
+    uint32_t abi;
+    uint32_t count;
+    const PluginFilter *filters;
+};
+
+extern "C" typedef const GlassesPlugin* (*PluginEntry)(void);
+
+#endif
@@ -0,0 +1,179 @@
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include "pluginloader.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    // The fastest version of a filter this CPU can run
+    ConfigFilterFunc best(const PluginFilter &pf)
+    {
+#ifdef HAVE_CPU_DISPATCH
+        if (pf.avx2 && __builtin_cpu_supports("avx2"))
+            return pf.avx2;
+        if (pf.sse2 && __builtin_cpu_supports("sse2"))
+            return pf.sse2;
+#endif
+        return pf.f;
+    }
+}
+
+PluginLoader::PluginLoader(const char *dir) : dir(dir)
+{
+    Context c(string("When loading plugins from ") + dir);
+    scan();
+}
+
+PluginLoader::~PluginLoader()
+{
+    vector<void*>::iterator r;
+    for (r = retired.begin(); r != retired.end(); ++r)
+        dlclose(*r);
+
+    map<string, Plugin>::iterator p;
+    for (p = plugins.begin(); p != plugins.end(); ++p)
+    {
+        if (!p->second.handle)
+            continue;
+        vector<string>::const_iterator n;
+        for (n = p->second.names.begin(); n != p->second.names.end(); ++n)
+            FilterRegistry::get().remove(*n);
+        dlclose(p->second.handle);
+    }
+}
+
+bool PluginLoader::scan(void)
+{
+    Context c("When scanning " + dir + " for plugins");
+
+    // Whatever was replaced last time has been looked up again by now
+    vector<void*>::iterator r;
+    for (r = retired.begin(); r != retired.end(); ++r)
+        dlclose(*r);
+    retired.clear();
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        throw PluginError("Couldn't open plugin directory " + dir + ": " + strerror(errno));
+
+    bool changed = false;
+    struct dirent *e;
+    while ((e = readdir(d)))
+    {
+        const string name(e->d_name);
+        if (name.size() < 4 || name.compare(name.size()-3, 3, ".so") != 0)
+            continue;
+
+        const string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        Plugin &p = plugins[path];
+        if (p.mtime == st.st_mtime && p.size == st.st_size)
+            continue;
+        // Don't retry a broken build until it changes again
+        p.mtime = st.st_mtime;
+        p.size  = st.st_size;
+
+        try {
+            const bool reload = p.handle;
+            load(path, p);
+            changed = true;
+            cerr << (reload ? "Reloaded plugin " : "Loaded plugin ") << path << endl;
+        } catch (const Exception &ex) {
+            cerr << "Not loading plugin " << path << ": " << ex.message() << endl;
+        }
+    }
+    closedir(d);
+    return changed;
+}
+
+void PluginLoader::load(const string &path, Plugin &p)
+{
+    Context c("When loading plugin " + path);
+
+    // dlopen hands back the old handle for a path it already has open, so
+    // load a private copy instead. Once it's mapped, the copy can go.
+    char tmp[] = "/tmp/glasses-plugin-XXXXXX";
+    int fd = mkstemp(tmp);
+    if (fd < 0)
+        throw PluginError(string("Couldn't create a temporary file: ") + strerror(errno));
+    close(fd);
+    {
+        ifstream from(path.c_str(), ios::binary);
+        ofstream to(tmp, ios::binary);
+        to << from.rdbuf();
+        if (!from || !to)
+        {
+            unlink(tmp);
+            throw PluginError("Couldn't copy the plugin to " + string(tmp));
+        }
+    }
+    void *h = dlopen(tmp, RTLD_NOW | RTLD_LOCAL);
+    unlink(tmp);
+    if (!h)
+        throw PluginError(dlerror());
+
+    try {
+        PluginEntry entry;
+        // The POSIX-blessed way to turn a data pointer into a function pointer
+        *reinterpret_cast<void**>(&entry) = dlsym(h, GLASSES_PLUGIN_ENTRY);
+        if (!entry)
+            throw PluginError("No " GLASSES_PLUGIN_ENTRY " function");
+
+        const GlassesPlugin *gp = entry();
+        if (!gp)
+            throw PluginError(GLASSES_PLUGIN_ENTRY " returned nothing");
+        if (gp->abi != GLASSES_PLUGIN_ABI)
+            throw PluginError("Built for plugin ABI " + stringify(gp->abi) + ", but this is " + stringify(GLASSES_PLUGIN_ABI));
+
+        vector<string> names;
+        vector<FilterInfo> infos;
+        for (uint32_t i = 0; i < gp->count; ++i)
+        {
+            const PluginFilter &pf = gp->filters[i];
+            if (!pf.name || !pf.f)
+                throw PluginError("Filter " + stringify(i) + " has no name or function");
+
+            FilterInfo info(best(pf), pf.flags, pf.config_size, pf.defaults, pf.set);
+            for (const PluginParam *param = pf.params; param && param->name; ++param)
+                info.params.push_back(param->name);
+            if (!info.params.empty() && !info.set)
+                throw PluginError(string("Filter ") + pf.name + " has parameters but no way to set them");
+
+            names.push_back(pf.name);
+            infos.push_back(info);
+        }
+
+        // Graphs might still be using a filter that went away, so don't let it
+        vector<string>::const_iterator n;
+        for (n = p.names.begin(); n != p.names.end(); ++n)
+            if (find(names.begin(), names.end(), *n) == names.end())
+                throw PluginError("The new version no longer has filter " + *n);
+
+        for (uint32_t i = 0; i < names.size(); ++i)
+            FilterRegistry::get().add(names[i], infos[i]);
+        p.names = names;
+    } catch (...) {
+        dlclose(h);
+        throw;
+    }
+
+    if (p.handle)
+        retired.push_back(p.handle);
+    p.handle = h;
+}
@@ -0,0 +1,64 @@
+#ifndef PLUGINLOADER_H
+#define PLUGINLOADER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "global.h"
+#include "plugin.h"
+
+// Loads every *.so in a directory and puts its filters in the FilterRegistry.
+// A plugin that gets rebuilt is loaded again and its filters replaced.
+class PluginLoader
+{
+    public:
+        /**
+         * @param dir   Directory to load plugins from
+         */
+        explicit PluginLoader(const char *dir);
+
+        /** Unloads the plugins. Nothing may still be using their filters. */
+        ~PluginLoader();
+
+        /**
+         * Load new plugins and reload changed ones. Plugins that fail to load
+         * are reported on stderr and skipped (a reload keeps the old version).
+         * Filters that came from a reloaded plugin must be looked up in the
+         * registry again before the next scan, which unloads the old version.
+         * @return  Whether any filters changed
+         */
+        bool scan(void);
+
+    private:
+        struct Plugin {
+            Plugin() : handle(NULL), mtime(0), size(0) {};
+            void *handle;
+            // To notice rebuilds
+            time_t mtime;
+            off_t size;
+            std::vector<std::string> names;
+        };
+
+        /** Load a plugin, replacing p if it works */
+        void load(const std::string &path, Plugin &p);
+
+        const std::string dir;
+        std::map<std::string, Plugin> plugins;
+        // Replaced versions, closed on the next scan
+        std::vector<void*> retired;
+
+        explicit PluginLoader(const PluginLoader&);
+        PluginLoader& operator=(const PluginLoader&);
+};
+
+class PluginError : public novas0x2a::Exception
+{
+    public:
+        PluginError(const std::string& our_message) throw ():
+            Exception(our_message) {};
+};
+
+#endif
@@ -0,0 +1,94 @@
+// An example plugin: black and white, split at a brightness level.
+// Build it with 'make plugins', then add a line like
+//     15 threshold 1 level=100
+// to a graph file and run glasses -p plugins <source> <graph file>
+
+#include <cstring>
+#include <cstdlib>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../plugin.h"
+
+// Each slot the filter is in has its own
+struct Settings {
+    uint32_t level;
+};
+
+static void defaults(void *config)
+{
+    static_cast<Settings*>(config)->level = 128;
+}
+
+static void threshold(const void *config, const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
+{
+    const uint32_t level = static_cast<const Settings*>(config)->level;
+    for (uint32_t i = 0; i < width*height; ++i)
+        out[i] = Vb(in[i]) > level ? RGB(0xff,0xff,0xff) : RGB(0,0,0);
+}
+
+#ifdef __SSE2__
+// Same thing (give or take rounding), four pixels at a time, with the NTSC
+// weights in 8.8 fixed point
+static void threshold_sse2(const void *config, const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height)
+{
+    const uint32_t level = static_cast<const Settings*>(config)->level;
+    const uint32_t n = width*height;
+    const __m128i zero    = _mm_setzero_si128();
+    // B, G, R, A
+    const __m128i weights = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+    const __m128i cutoff  = _mm_set1_epi32(level);
+    // RGB() leaves alpha at 1
+    const __m128i black   = _mm_set1_epi32(0x01000000);
+    const __m128i white   = _mm_set1_epi32(0x00ffffff);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), weights);
+        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), weights);
+        // Each pixel left two partial sums; add the pairs up
+        __m128i luma = _mm_add_epi32(
+                _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2,0,2,0))),
+                _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3,1,3,1))));
+        luma = _mm_srli_epi32(luma, 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                _mm_or_si128(black, _mm_and_si128(_mm_cmpgt_epi32(luma, cutoff), white)));
+    }
+    threshold(config, in + i, out + i, n - i, 1);
+}
+#endif
+
+static int set(void *config, const char *key, const char *value)
+{
+    if (strcmp(key, "level") != 0)
+        return -1;
+    char *end;
+    long l = strtol(value, &end, 10);
+    if (*end || l < 0 || l > 255)
+        return -1;
+    static_cast<Settings*>(config)->level = l;
+    return 0;
+}
+
+static const PluginParam params[] = {
+    {"level", "brightness cutoff, 0-255 (default 128)"},
+    {NULL, NULL}
+};
+
+static const PluginFilter filters[] = {
+#ifdef __SSE2__
+    {"threshold", threshold, FILTER_POINTWISE, params, sizeof(Settings), defaults, set, threshold_sse2, NULL}
+#else
+    {"threshold", threshold, FILTER_POINTWISE, params, sizeof(Settings), defaults, set, NULL, NULL}
+#endif
+};
+
+static const GlassesPlugin plugin = {GLASSES_PLUGIN_ABI, sizeof(filters)/sizeof(*filters), filters};
+
+extern "C" const GlassesPlugin* glasses_plugin(void)
+{
+    return &plugin;
+}
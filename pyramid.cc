@@ -0,0 +1,143 @@
+#include <sched.h>
+
+#include "global.h"
+#include "pyramid.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    // Each thread runs its own filter
+    __thread Pyramid *current = NULL;
+
+#ifdef __SSE2__
+    // (a+b+c+d+2)>>2 for each byte. Averaging the averages rounds up twice,
+    // so take back the extra one where both roundings happened.
+    inline __m128i mean4(__m128i a, __m128i b, __m128i c, __m128i d)
+    {
+        const __m128i t1 = _mm_avg_epu8(a, b), t2 = _mm_avg_epu8(c, d);
+        const __m128i odd = _mm_or_si128(_mm_xor_si128(a, b), _mm_xor_si128(c, d));
+        const __m128i fix = _mm_and_si128(_mm_and_si128(odd, _mm_xor_si128(t1, t2)), _mm_set1_epi8(1));
+        return _mm_sub_epi8(_mm_avg_epu8(t1, t2), fix);
+    }
+
+    // Split 8 pixels into the even ones and the odd ones
+    inline void split32(const byte *p, __m128i &even, __m128i &odd)
+    {
+        const __m128 lo = _mm_loadu_ps(reinterpret_cast<const float*>(p));
+        const __m128 hi = _mm_loadu_ps(reinterpret_cast<const float*>(p + 16));
+        even = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2,0,2,0)));
+        odd  = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3,1,3,1)));
+    }
+
+    // ... and 32 bytes
+    inline void split8(const byte *p, __m128i &even, __m128i &odd)
+    {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+        const __m128i mask = _mm_set1_epi16(0x00ff);
+        even = _mm_packus_epi16(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+        odd  = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+    }
+#endif
+
+    // Halve a frame of bpp-byte pixels. width and height are the output's.
+    void reduce(const byte *in, uint32_t in_width, byte *out, uint32_t width, uint32_t height, uint32_t bpp)
+    {
+        const size_t in_row = size_t(in_width) * bpp, row = size_t(width) * bpp;
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const byte *r0 = in + 2*y*in_row, *r1 = r0 + in_row;
+            byte *o = out + y*row;
+            size_t i = 0;
+#ifdef __SSE2__
+            // 16 bytes out for 32 from each of the two rows
+            for (; i + 16 <= row; i += 16)
+            {
+                __m128i a, b, c, d;
+                if (bpp == 4)
+                {
+                    split32(r0 + 2*i, a, b);
+                    split32(r1 + 2*i, c, d);
+                }
+                else
+                {
+                    split8(r0 + 2*i, a, b);
+                    split8(r1 + 2*i, c, d);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i), mean4(a, b, c, d));
+            }
+#endif
+            for (; i < row; ++i)
+            {
+                const size_t x = i / bpp, c = i % bpp, l = 2*x*bpp + c, r = l + bpp;
+                o[i] = (r0[l] + r0[r] + r1[l] + r1[r] + 2) >> 2;
+            }
+        }
+    }
+}
+
+void Pyramid::reset(const byte *base, PixelFormat format, uint32_t width, uint32_t height)
+{
+    this->base   = base;
+    this->format = format;
+    built = 1;
+
+    sizes.clear();
+    sizes.push_back(make_pair(width, height));
+    if (format != FORMAT_BGRA32 && format != FORMAT_GRAY8)
+        return;
+    while (width >= 2 && height >= 2)
+    {
+        width  /= 2;
+        height /= 2;
+        sizes.push_back(make_pair(width, height));
+    }
+    // Levels move if this grows, so it only happens here, before anyone
+    // has one
+    if (reduced.size() < sizes.size() - 1)
+        reduced.resize(sizes.size() - 1);
+}
+
+uint32_t Pyramid::levels(void) const
+{
+    return sizes.size();
+}
+
+const byte* Pyramid::level(uint32_t k)
+{
+    if (k >= sizes.size())
+        throw ArgumentError("Level " + stringify(k) + " is past the top of the pyramid (" + stringify(sizes.size()) + " levels)");
+    if (k == 0)
+        return base;
+
+    const uint32_t bpp = format == FORMAT_BGRA32 ? sizeof(Pixel) : 1;
+    while (__atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE))
+        sched_yield();
+    for (; built <= k; ++built)
+    {
+        vector<byte> &out = reduced[built-1];
+        out.resize(size_t(getWidth(built)) * getHeight(built) * bpp);
+        const byte *in = built == 1 ? base : &reduced[built-2][0];
+        reduce(in, getWidth(built-1), &out[0], getWidth(built), getHeight(built), bpp);
+    }
+    __atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+    return &reduced[k-1][0];
+}
+
+Pyramid& input_pyramid(void)
+{
+    if (!current)
+        throw GeneralError(DEBUG_HERE, "There's no input pyramid outside a filter");
+    return *current;
+}
+
+void set_input_pyramid(Pyramid *p)
+{
+    current = p;
+}
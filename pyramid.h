@@ -0,0 +1,66 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <vector>
+
+#include "global.h"
+#include "video/format.h"
+
+// Successive halvings of a frame, for coarse-to-fine work. Level 0 is the
+// frame itself; each level after it is the 2x2 mean of the one before
+// (rounded, and dropping the last row or column of an odd size). Levels are
+// only worked out when asked for, and are kept until reset, so any number of
+// filters can read the same level of a frame for the price of one.
+class Pyramid
+{
+    public:
+        Pyramid() : base(NULL), format(FORMAT_BGRA32), built(1), busy(0) {};
+
+        /**
+         * Start over on a new frame, forgetting the levels of the last one
+         * @param base      the frame, which has to stay put until the next reset
+         * @param format    BGRA32 or GRAY8. Other formats have only level 0.
+         * @param width     size of the frame
+         * @param height
+         */
+        void reset(const byte *base, PixelFormat format, uint32_t width, uint32_t height);
+
+        /**
+         * A level, working it out (and any above it) if need be. Filters on
+         * other threads can ask at the same time.
+         * @param k     0 for the frame, up to levels()-1
+         * @return      getWidth(k)*getHeight(k) pixels in getFormat()
+         * @throw ArgumentError if there's no level k
+         */
+        const byte* level(uint32_t k);
+
+        /** How many levels there are, counting the frame. Stops short of 1 pixel across. */
+        uint32_t levels(void) const;
+
+        inline uint32_t getWidth(uint32_t k)  const {return k < sizes.size() ? sizes[k].first  : 0;};
+        inline uint32_t getHeight(uint32_t k) const {return k < sizes.size() ? sizes[k].second : 0;};
+        inline PixelFormat getFormat(void)    const {return format;};
+
+    private:
+        const byte *base;
+        PixelFormat format;
+        // Size of every level there can be
+        std::vector<std::pair<uint32_t, uint32_t> > sizes;
+        // Levels 1 and up; the first built-1 are good for this frame
+        std::vector<std::vector<byte> > reduced;
+        uint32_t built;
+        // Held while levels are being worked out
+        int busy;
+};
+
+/**
+ * The pyramid of the frame the running filter reads. Its format is the source
+ * slot's, which isn't always the filter's (check getFormat).
+ * @throw GeneralError outside a filter
+ */
+Pyramid& input_pyramid(void);
+
+/** For the window: say whose pyramid input_pyramid is on this thread (NULL: nobody's) */
+void set_input_pyramid(Pyramid *p);
+
+#endif
@@ -0,0 +1,225 @@
+#include <iomanip>
+
+#include "qos.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    // Frames to wait after cutting back, and after putting back (longer,
+    // so a slot doesn't flap in and out)
+    const uint32_t shed_hold = 8, restore_hold = 30;
+
+    // Every how many frames a slot runs at each level (0: never)
+    const uint32_t every[SHED_LEVELS] = {1, 1, 2, 4, 8, 0};
+
+    // Averages move an eighth of the way to each new sample
+    inline uint64_t ewma(uint64_t avg, uint64_t sample)
+    {
+        return avg ? avg - avg / 8 + sample / 8 : sample;
+    }
+}
+
+Priority priorityByName(const string &name)
+{
+    if (name == "low")
+        return PRIORITY_LOW;
+    if (name == "normal")
+        return PRIORITY_NORMAL;
+    if (name == "high")
+        return PRIORITY_HIGH;
+    if (name == "critical")
+        return PRIORITY_CRITICAL;
+    throw ArgumentError("Unknown priority " + name + " (try low, normal, high or critical)");
+}
+
+const char* priorityName(Priority p)
+{
+    static const char *names[] = {"low", "normal", "high", "critical"};
+    return names[p];
+}
+
+const char* shedName(ShedLevel l)
+{
+    static const char *names[SHED_LEVELS] = {"every frame", "half size", "every 2nd frame", "every 4th frame", "every 8th frame", "off"};
+    return names[l];
+}
+
+void LoadShedder::setBudget(uint64_t ns)
+{
+    budget = ns;
+    load = 0;
+    hold = 0;
+    if (!budget)
+        for (vector<Slot>::iterator s = slots.begin(); s != slots.end(); ++s)
+            s->level = SHED_NONE;
+}
+
+void LoadShedder::clear(void)
+{
+    for (vector<Slot>::iterator s = slots.begin(); s != slots.end(); ++s)
+        s->used = false;
+}
+
+void LoadShedder::setSlot(uint32_t idx, const string &name, Priority priority, bool proxy)
+{
+    if (idx >= slots.size())
+        slots.resize(idx + 1);
+    Slot &s = slots[idx];
+    // A new filter starts over
+    if (s.name != name)
+        s = Slot();
+    s.used     = true;
+    s.name     = name;
+    s.priority = priority;
+    s.proxy    = proxy;
+    // Whatever can't be cut back any more goes back in full
+    if (priority == PRIORITY_CRITICAL || (s.level == SHED_PROXY && !proxy))
+        s.level = SHED_NONE;
+}
+
+bool LoadShedder::runs(uint32_t idx) const
+{
+    if (idx >= slots.size())
+        return true;
+    const uint32_t n = every[slots[idx].level];
+    // Staggered by slot, so the slots cut back don't all run the same frame
+    return n && (frames + idx) % n == 0;
+}
+
+void LoadShedder::spent(uint32_t idx, uint64_t ns)
+{
+    if (idx >= slots.size())
+        return;
+    Slot &s = slots[idx];
+    ++s.runs;
+    s.worked = true;
+    // A half-size run says little about a full one
+    if (s.level == SHED_PROXY)
+        s.proxy_cost = ewma(s.proxy_cost, ns);
+    else
+        s.cost = ewma(s.cost, ns);
+}
+
+uint64_t LoadShedder::share(const Slot &s, ShedLevel l) const
+{
+    // Until a half-size run has been timed, guess at a quarter of the pixels
+    if (l == SHED_PROXY)
+        return s.proxy_cost ? s.proxy_cost : s.cost / 4;
+    return every[l] ? s.cost / every[l] : 0;
+}
+
+void LoadShedder::skipped(uint32_t idx)
+{
+    if (idx >= slots.size())
+        return;
+    ++slots[idx].skips;
+    slots[idx].worked = true;
+}
+
+ShedLevel LoadShedder::harsher(const Slot &s) const
+{
+    if (s.level == SHED_NONE && !s.proxy)
+        return SHED_HALF;
+    return ShedLevel(s.level + 1);
+}
+
+ShedLevel LoadShedder::milder(const Slot &s) const
+{
+    if (s.level == SHED_HALF && !s.proxy)
+        return SHED_NONE;
+    return ShedLevel(s.level - 1);
+}
+
+int32_t LoadShedder::frame(uint64_t ns)
+{
+    for (vector<Slot>::iterator s = slots.begin(); s != slots.end(); ++s)
+    {
+        s->busy = s->busy - s->busy / 8 + (s->worked ? 128 : 0);
+        s->worked = false;
+    }
+    ++frames;
+
+    if (!budget)
+        return -1;
+    load = ewma(load, ns);
+    if (hold)
+    {
+        --hold;
+        return -1;
+    }
+
+    int32_t pick = -1;
+    if (load > budget)
+    {
+        // The least important slot first, and of those, the dearest
+        for (uint32_t idx = 0; idx < slots.size(); ++idx)
+        {
+            const Slot &s = slots[idx];
+            if (!s.used || s.priority == PRIORITY_CRITICAL || s.level == SHED_OFF)
+                continue;
+            if (pick < 0 || s.priority < slots[pick].priority ||
+                (s.priority == slots[pick].priority && s.cost > slots[pick].cost))
+                pick = idx;
+        }
+        if (pick < 0)
+            return -1;
+        Slot &s = slots[pick];
+        s.level = harsher(s);
+        hold = shed_hold;
+        ++sheds;
+        cerr << "Frames are taking " << load / 1000 << "us of " << budget / 1000 << "us: running slot "
+             << pick << " (" << s.name << ") " << shedName(s.level) << endl;
+        return pick;
+    }
+
+    // Only put a slot back if there'd still be time to spare with it, going
+    // by how often it's had anything to do lately
+    if (load < budget * 3 / 4)
+    {
+        for (uint32_t idx = 0; idx < slots.size(); ++idx)
+        {
+            const Slot &s = slots[idx];
+            if (!s.used || s.level == SHED_NONE)
+                continue;
+            if (pick < 0 || s.priority > slots[pick].priority ||
+                (s.priority == slots[pick].priority && s.level < slots[pick].level))
+                pick = idx;
+        }
+        if (pick < 0)
+            return -1;
+        Slot &s = slots[pick];
+        const ShedLevel next = milder(s);
+        const uint64_t more = share(s, next), less = share(s, s.level);
+        if (more > less && load + (more - less) * s.busy / 1024 > budget * 7 / 8)
+            return -1;
+        s.level = next;
+        hold = restore_hold;
+        ++restores;
+        cerr << "Frames are taking " << load / 1000 << "us of " << budget / 1000 << "us: running slot "
+             << pick << " (" << s.name << ") " << shedName(s.level) << endl;
+        return pick;
+    }
+    return -1;
+}
+
+void LoadShedder::report(ostream &os) const
+{
+    os << "Filter time per frame: ";
+    if (budget)
+        os << load / 1000 << "us of " << budget / 1000 << "us, " << sheds << " cutbacks, " << restores << " restored";
+    else
+        os << "no budget";
+    os << endl;
+
+    for (uint32_t idx = 0; idx < slots.size(); ++idx)
+    {
+        const Slot &s = slots[idx];
+        if (!s.used)
+            continue;
+        os << "  " << setw(3) << idx << " " << left << setw(16) << s.name << right
+           << setw(9) << priorityName(s.priority) << setw(9) << s.cost / 1000 << "us "
+           << setw(8) << s.runs << " runs " << setw(8) << s.skips << " skipped  " << shedName(s.level) << endl;
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef QOS_H
+#define QOS_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "global.h"
+
+// How much a slot matters when there isn't time to run them all. Slots
+// are cut back lowest first; critical ones never are.
+enum Priority
+{
+    PRIORITY_LOW,
+    PRIORITY_NORMAL,
+    PRIORITY_HIGH,
+    PRIORITY_CRITICAL
+};
+
+/**
+ * Look up a priority by name: low, normal, high or critical
+ * @throw ArgumentError for anything else
+ */
+Priority priorityByName(const std::string &name);
+const char* priorityName(Priority p);
+
+// How far a slot has been cut back, mildest first
+enum ShedLevel
+{
+    SHED_NONE,      // runs every frame
+    SHED_PROXY,     // runs every frame, on a half-size copy of its input
+    SHED_HALF,      // runs every other frame
+    SHED_QUARTER,   // every fourth
+    SHED_EIGHTH,    // every eighth
+    SHED_OFF,       // doesn't run; the slot keeps its last frame
+    SHED_LEVELS
+};
+
+const char* shedName(ShedLevel l);
+
+// Keeps the filters inside a time budget per frame. It learns what each slot
+// costs to run, and when frames take longer than the budget, cuts back the
+// least important, most expensive slot a step at a time; when there's time
+// to spare again, it puts the most important one back a step. Each change
+// is given a few frames to show before the next.
+class LoadShedder
+{
+    public:
+        LoadShedder() : budget(0), load(0), frames(0), hold(0), sheds(0), restores(0) {};
+
+        /**
+         * @param ns    time the filters get per frame, in nanoseconds. 0
+         *              turns shedding off and puts every slot back.
+         */
+        void setBudget(uint64_t ns);
+        inline uint64_t getBudget(void) const {return budget;};
+
+        /**
+         * Say what's in a slot. Slots not described since the last clear
+         * are left alone.
+         * @param idx       slot
+         * @param name      what to call it in reports
+         * @param priority  how much it (or anything reading it) matters
+         * @param proxy     whether it can run on a half-size input
+         */
+        void setSlot(uint32_t idx, const std::string &name, Priority priority, bool proxy);
+
+        /** Forget what's in every slot, ahead of describing them again */
+        void clear(void);
+
+        /** Whether a slot runs this frame at all */
+        bool runs(uint32_t idx) const;
+
+        /** Whether a slot runs on a half-size input this frame */
+        inline bool proxied(uint32_t idx) const {return idx < slots.size() && slots[idx].level == SHED_PROXY;};
+
+        /**
+         * Note how long a slot took to run
+         * @param idx   slot
+         * @param ns    nanoseconds
+         */
+        void spent(uint32_t idx, uint64_t ns);
+
+        /** Note that a slot had work to do, but sat it out as told */
+        void skipped(uint32_t idx);
+
+        /**
+         * Finish a frame, and cut back or put back a slot if it's time to
+         * @param ns    how long the filters took this frame, all told
+         * @return      the slot whose level changed, or -1. Its next run
+         *              has to redo the whole frame.
+         */
+        int32_t frame(uint64_t ns);
+
+        /** Say what's been cut back, and what everything costs */
+        void report(std::ostream &os) const;
+
+    private:
+        struct Slot
+        {
+            Slot() : used(false), proxy(false), priority(PRIORITY_NORMAL), level(SHED_NONE), cost(0), proxy_cost(0), runs(0), skips(0),
+                    worked(false), busy(1024) {};
+            bool used, proxy;
+            std::string name;
+            Priority priority;
+            ShedLevel level;
+            // Average nanoseconds a full-size and a half-size run take,
+            // runs and frames skipped
+            uint64_t cost, proxy_cost, runs, skips;
+            // Whether it had anything to do this frame, and how often it
+            // has lately (out of 1024)
+            bool worked;
+            uint32_t busy;
+        };
+
+        /** What a slot costs per frame at a level, in nanoseconds */
+        uint64_t share(const Slot &s, ShedLevel l) const;
+        /** A step further from (or back towards) running every frame */
+        ShedLevel harsher(const Slot &s) const;
+        ShedLevel milder(const Slot &s) const;
+
+        std::vector<Slot> slots;
+        // Per frame, in nanoseconds: what the filters get, and an average
+        // of what they've been taking
+        uint64_t budget, load;
+        uint64_t frames;
+        // Frames left before the next change
+        uint32_t hold;
+        uint64_t sheds, restores;
+};
+
+#endif
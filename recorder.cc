@@ -0,0 +1,193 @@
+#include <iostream>
+#include <cerrno>
+#include <cmath>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "recorder.h"
+#include "utils/io.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+Recorder::Recorder(const string &name, uint32_t width, uint32_t height, double fps, uint32_t depth) :
+    width(width), height(height), fd(-1), queue(depth), stopping(false), running(false), written(0), dropped(0),
+    last(0), end(0), failed(false)
+{
+    Context c("When starting to record to " + name);
+    const size_t dot = name.rfind('.'), slash = name.rfind('/');
+    const bool has_ext = dot != string::npos && (slash == string::npos || dot > slash);
+    const string stem = has_ext ? name.substr(0, dot) : name, ext = has_ext ? name.substr(dot) : "";
+    y4m = ext == ".y4m";
+
+    for (uint32_t i = 0; fd < 0; ++i)
+    {
+        path = stem + stringify(i) + ext;
+        fd = open(path.c_str(), O_CREAT|O_EXCL|O_WRONLY, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
+        if (fd < 0 && errno != EEXIST)
+            throw GeneralError(DEBUG_HERE, "Couldn't create " + path + ": " + strerror(errno));
+    }
+
+    try {
+        if (y4m)
+        {
+            // The rate as a fraction over 1000, so 29.97 survives
+            const uint32_t rate = fps > 0 ? uint32_t(floor(fps * 1000 + 0.5)) : 30000;
+            const string header = "YUV4MPEG2 W" + stringify(width) + " H" + stringify(height)
+                + " F" + stringify(rate) + ":1000 Ip A1:1 C420jpeg\n";
+            vector<iovec> iov(1, piece(header.data(), header.size()));
+            writev_all(fd, iov);
+            last = end = header.size();
+        }
+
+        // Every slot is sized for the biggest frame up front, so the main
+        // loop never allocates
+        vector<Frame> &slots = queue.all();
+        for (size_t i = 0; i < slots.size(); ++i)
+            slots[i].pixels.reserve(frameBytes(FORMAT_BGRA32, width, height));
+
+        sem_init(&ready, 0, 0);
+        if (pthread_create(&thread, NULL, run, this) != 0)
+        {
+            sem_destroy(&ready);
+            throw GeneralError(DEBUG_HERE, "Couldn't start the recording thread");
+        }
+        running = true;
+    } catch (...) {
+        // Nothing was recorded, so don't leave an empty file behind
+        close(fd);
+        unlink(path.c_str());
+        throw;
+    }
+}
+
+Recorder::~Recorder(void)
+{
+    stop();
+    sem_destroy(&ready);
+    if (close(fd) != 0)
+        cerr << "Couldn't finish writing " << path << ": " << strerror(errno) << endl;
+}
+
+void Recorder::stop(void)
+{
+    if (!running)
+        return;
+    __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+    sem_post(&ready);
+    pthread_join(thread, NULL);
+    running = false;
+}
+
+uint64_t Recorder::getWritten(void) const
+{
+    return __atomic_load_n(&written, __ATOMIC_RELAXED);
+}
+
+uint64_t Recorder::getDropped(void) const
+{
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+bool Recorder::push(PixelFormat format, const byte *pixels, size_t pitch)
+{
+    Frame *f = running ? queue.claim() : NULL;
+    if (!f)
+    {
+        __atomic_store_n(&dropped, dropped + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    const size_t row = frameBytes(format, width, 1);
+    f->format = format;
+    f->pixels.resize(row * height);
+    if (pitch == row)
+        memcpy(&f->pixels[0], pixels, row * height);
+    else
+        for (uint32_t y = 0; y < height; ++y)
+            memcpy(&f->pixels[y*row], pixels + y*pitch, row);
+
+    queue.publish();
+    sem_post(&ready);
+    return true;
+}
+
+void* Recorder::run(void *self)
+{
+    static_cast<Recorder*>(self)->drain();
+    return NULL;
+}
+
+void Recorder::drain(void)
+{
+    for (;;)
+    {
+        while (sem_wait(&ready) != 0 && errno == EINTR)
+            ;
+        Frame *f = queue.front();
+        // The stop comes after every frame, so nothing gets left behind
+        if (!f)
+        {
+            if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+                return;
+            continue;
+        }
+
+        // After a failure the queue still has to drain, or push would fill it
+        if (!failed)
+        {
+            try {
+                write(*f);
+                __atomic_store_n(&written, written + 1, __ATOMIC_RELAXED);
+            } catch (const Exception &e) {
+                cerr << "Stopped recording to " << path << ": " << e.message() << endl;
+                failed = true;
+            }
+        }
+        queue.pop();
+    }
+}
+
+void Recorder::write(const Frame &f)
+{
+    const byte *frame = &f.pixels[0];
+    if (f.format != FORMAT_BGRA32)
+    {
+        bgra.resize(frameBytes(FORMAT_BGRA32, width, height));
+        convertFrame(f.format, frame, FORMAT_BGRA32, &bgra[0], width, height);
+        frame = &bgra[0];
+    }
+
+    static const char marker[] = "FRAME\n";
+    vector<iovec> iov;
+    if (y4m)
+    {
+        yuv.resize(frameBytes(FORMAT_I420, width, height));
+        convertFrame(FORMAT_BGRA32, frame, FORMAT_I420, &yuv[0], width, height);
+        iov.push_back(piece(marker, sizeof(marker) - 1));
+        iov.push_back(piece(&yuv[0], yuv.size()));
+    }
+    else
+        iov.push_back(piece(frame, frameBytes(FORMAT_BGRA32, width, height)));
+
+    size_t length = 0;
+    for (size_t i = 0; i < iov.size(); ++i)
+        length += iov[i].iov_len;
+    writev_all(fd, iov);
+
+    // Start this frame on its way to disk, then wait for the one before
+    // (which has had a whole frame's time to get there) and drop it from
+    // the cache
+    sync_file_range(fd, end, length, SYNC_FILE_RANGE_WRITE);
+    if (end > last)
+    {
+        sync_file_range(fd, last, end - last, SYNC_FILE_RANGE_WAIT_BEFORE|SYNC_FILE_RANGE_WRITE|SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, last, end - last, POSIX_FADV_DONTNEED);
+    }
+    last = end;
+    end += length;
+}
@@ -0,0 +1,86 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+
+#include "global.h"
+#include "utils/spsc.h"
+#include "video/format.h"
+
+// Records frames to a file as they go by, for playing back later. Frames are
+// copied into a fixed queue and a thread of its own converts and writes them,
+// so push never waits: when the writer falls behind, frames are dropped (and
+// counted) instead. Written frames are pushed out of the page cache as soon
+// as they're on disk, so a long recording doesn't crowd out everything else.
+class Recorder
+{
+    public:
+        /**
+         * Start recording
+         * @param path      where to write. The first free name with a number
+         *                  before the extension is used (rec.y4m gives rec0.y4m,
+         *                  rec1.y4m, ...). *.y4m is YUV4MPEG2 4:2:0, and anything
+         *                  else is raw BGRA frames, as Playback reads *.raw.
+         * @param width     size of every frame
+         * @param height
+         * @param fps       frame rate to put in a Y4M header
+         * @param depth     how many frames can be waiting to be written
+         */
+        Recorder(const std::string &path, uint32_t width, uint32_t height, double fps, uint32_t depth = 8);
+        /** Stops, and closes the file */
+        ~Recorder(void);
+
+        /** Write whatever is still queued, and stop. Frames pushed after this are dropped. */
+        void stop(void);
+
+        /**
+         * Queue a frame
+         * @param format    any format convertFrame can turn into BGRA32
+         * @param pixels    height rows of width pixels
+         * @param pitch     bytes from the start of one row to the next
+         * @return          false if the queue was full and the frame dropped
+         */
+        bool push(PixelFormat format, const byte *pixels, size_t pitch);
+
+        uint64_t getWritten(void) const;
+        uint64_t getDropped(void) const;
+        inline const std::string& getPath(void) const {return path;};
+
+    private:
+        struct Frame
+        {
+            PixelFormat format;
+            std::vector<byte> pixels;
+        };
+
+        static void* run(void *self);
+        void drain(void);
+        void write(const Frame &f);
+
+        std::string path;
+        const uint32_t width, height;
+        bool y4m;
+        int fd;
+
+        novas0x2a::SpscRing<Frame> queue;
+        // Posted once per frame queued, and once more to stop
+        sem_t ready;
+        bool stopping, running;
+        pthread_t thread;
+        uint64_t written, dropped;
+
+        // The writer's: scratch for conversions, and how far the file has
+        // got (the last frame's start, and the end)
+        std::vector<byte> bgra, yuv;
+        off_t last, end;
+        bool failed;
+
+        explicit Recorder(const Recorder&);
+        Recorder& operator=(const Recorder&);
+};
+
+#endif
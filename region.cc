@@ -0,0 +1,54 @@
+#include <algorithm>
+
+#include "region.h"
+
+using namespace std;
+
+void Region::add(const Rect &r)
+{
+    if (r.empty())
+        return;
+
+    if (!rs.empty())
+    {
+        Rect &last = rs.back();
+        if (last.y == r.y && last.h == r.h && last.x + last.w == r.x)
+        {
+            last.w += r.w;
+            return;
+        }
+    }
+
+    rs.push_back(r);
+
+    if (unlikely(rs.size() > max_rects))
+    {
+        Rect b = bounds();
+        rs.clear();
+        rs.push_back(b);
+    }
+}
+
+void Region::add(const Region &r)
+{
+    vector<Rect>::const_iterator i;
+    for (i = r.rs.begin(); i != r.rs.end(); ++i)
+        add(*i);
+}
+
+Rect Region::bounds(void) const
+{
+    if (rs.empty())
+        return Rect();
+
+    uint32_t x0 = rs[0].x, y0 = rs[0].y, x1 = rs[0].x + rs[0].w, y1 = rs[0].y + rs[0].h;
+    vector<Rect>::const_iterator i;
+    for (i = rs.begin()+1; i != rs.end(); ++i)
+    {
+        x0 = min(x0, i->x);
+        y0 = min(y0, i->y);
+        x1 = max(x1, i->x + i->w);
+        y1 = max(y1, i->y + i->h);
+    }
+    return Rect(x0, y0, x1-x0, y1-y0);
+}
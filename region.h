@@ -0,0 +1,50 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <vector>
+#include "global.h"
+
+// An axis-aligned rectangle, in pixels
+struct Rect {
+    Rect() : x(0), y(0), w(0), h(0) {};
+    Rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h) : x(x), y(y), w(w), h(h) {};
+    inline bool empty(void) const {return w == 0 || h == 0;};
+    uint32_t x, y, w, h;
+};
+
+// A set of rectangles describing the parts of a frame that changed.
+// Rectangles are not guaranteed to be disjoint, and once there are too many
+// of them the set collapses into its bounding box.
+class Region
+{
+    public:
+        Region() {};
+
+        /**
+         * Add a rectangle. Merges with the last rectangle when they are
+         * horizontally adjacent on the same rows.
+         * @param r     The rectangle to add. Empty rectangles are ignored.
+         */
+        void add(const Rect &r);
+
+        /** Add every rectangle in another region */
+        void add(const Region &r);
+
+        /** Empty the region */
+        inline void clear(void) {rs.clear();};
+
+        inline bool empty(void) const {return rs.empty();};
+
+        /** The smallest rectangle that contains the whole region */
+        Rect bounds(void) const;
+
+        inline const std::vector<Rect>& rects(void) const {return rs;};
+
+        // Past this many rectangles, the region becomes its bounding box
+        static const uint32_t max_rects = 32;
+
+    private:
+        std::vector<Rect> rs;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "registry.h"
+#include "filters.h"
+
+using std::map;
+using std::string;
+using std::vector;
+using namespace novas0x2a;
+
+FilterRegistry& FilterRegistry::get(void)
+{
+    static FilterRegistry r;
+    return r;
+}
+
+FilterRegistry::FilterRegistry()
+{
+    add("copy",            FilterInfo(::copy,          FILTER_POINTWISE|FILTER_SCALABLE));
+    add("red",             FilterInfo(red,             FILTER_POINTWISE|FILTER_SCALABLE));
+    add("green",           FilterInfo(green,           FILTER_POINTWISE|FILTER_SCALABLE));
+    add("blue",            FilterInfo(blue,            FILTER_POINTWISE|FILTER_SCALABLE));
+    add("blur",            FilterInfo(blur,            FILTER_SCALABLE).parallel_rows(1, blur));
+    add("replace_blue",    FilterInfo(replace_blue,    FILTER_POINTWISE|FILTER_SCALABLE));
+    add("invert",          FilterInfo(invert,          FILTER_POINTWISE|FILTER_SCALABLE));
+    add("linear_contrast", FilterInfo(linear_contrast, FILTER_SCALABLE));
+    add("rgb_hist",        FilterInfo(rgb_hist,        FILTER_SERIAL));
+    add("frame_counter",   FilterInfo(frame_counter,   FILTER_VOLATILE|FILTER_SERIAL));
+    add("gray",            FilterInfo(gray,            FILTER_POINTWISE|FILTER_SCALABLE)
+                              .overload(FORMAT_BGRA32, FORMAT_GRAY8,  gray)
+                              .overload(FORMAT_GRAY8,  FORMAT_GRAY8,  gray_gray8));
+    add("edge",            FilterInfo(edge,            FILTER_SCALABLE).parallel_rows(1, edge)
+                              .overload(FORMAT_GRAY8,  FORMAT_GRAY8,  edge, edge));
+    add("gradient",        FilterInfo(gradient,        FILTER_SCALABLE).parallel_rows(1, gradient)
+                              .overload(FORMAT_GRAY8,  FORMAT_GRAY16, gradient, gradient));
+    add("colorize",        FilterInfo(colorize,        FILTER_SCALABLE)
+                              .overload(FORMAT_GRAY8,  FORMAT_BGRA32, colorize));
+    add("motion",          FilterInfo(motion,          0));
+    add("pyramid",         FilterInfo(pyramid,         0));
+}
+
+FilterParams FilterInfo::configure(const FilterParams &params, vector<byte> &config) const
+{
+    config.assign(config_size, 0);
+    if (!configured)
+        return params;
+    FilterParams rejected;
+    void *c = config.empty() ? NULL : &config[0];
+    if (defaults)
+        defaults(c);
+    FilterParams::const_iterator p;
+    for (p = params.begin(); p != params.end(); ++p)
+        if (!set || set(c, p->first.c_str(), p->second.c_str()) != 0)
+            rejected.push_back(*p);
+    return rejected;
+}
+
+void FilterRegistry::add(const string &name, const FilterInfo &info)
+{
+    filters[name] = info;
+}
+
+void FilterRegistry::remove(const string &name)
+{
+    filters.erase(name);
+}
+
+bool FilterRegistry::has(const string &name) const
+{
+    return filters.find(name) != filters.end();
+}
+
+const FilterInfo& FilterRegistry::find(const string &name) const
+{
+    map<string, FilterInfo>::const_iterator i = filters.find(name);
+    if (i == filters.end())
+        throw ArgumentError("No filter named \"" + name + "\"");
+    return i->second;
+}
+
+vector<string> FilterRegistry::names(void) const
+{
+    vector<string> ret;
+    map<string, FilterInfo>::const_iterator i;
+    for (i = filters.begin(); i != filters.end(); ++i)
+        ret.push_back(i->first);
+    return ret;
+}
@@ -0,0 +1,155 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "global.h"
+#include "video/format.h"
+
+// Characterizes a filter
+typedef void (*FilterFunc)(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
+
+// A version of a filter for frames that aren't both BGRA. in and out are
+// whole frames in the kernel's formats.
+typedef void (*KernelFunc)(const byte *in, byte *out, const uint32_t width, const uint32_t height);
+
+// Versions of a filter or kernel that do a band of rows at a time, so the
+// bands can run side by side: rows [y0, y1) of out, reading rows of in no
+// further from the band than the filter's halo. in and out are whole frames.
+typedef void (*RowsFunc)(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height,
+                         const uint32_t y0, const uint32_t y1);
+typedef void (*KernelRowsFunc)(const byte *in, byte *out, const uint32_t width, const uint32_t height,
+                               const uint32_t y0, const uint32_t y1);
+
+struct Kernel {
+    Kernel(PixelFormat in, PixelFormat out, KernelFunc f, KernelRowsFunc rows = NULL) : in(in), out(out), f(f), rows(rows) {};
+    PixelFormat in, out;
+    KernelFunc f;
+    // f for a band of rows, if there is one
+    KernelRowsFunc rows;
+};
+
+// Filter properties, used to decide when a filter can be skipped
+enum {
+    // Output changes even when the input doesn't (counters, noise). Always run.
+    FILTER_VOLATILE  = 1 << 0,
+    // Each output pixel depends only on the input pixel in the same place, so
+    // the filter can be run on just the rows that changed, and on bands of
+    // rows side by side.
+    FILTER_POINTWISE = 1 << 1,
+    // Works at any frame size, and keeps nothing sized to the frame between
+    // calls, so it can be run on a half-size copy of its input when there
+    // isn't time for the whole thing.
+    FILTER_SCALABLE  = 1 << 2,
+    // Keeps state between calls that isn't safe to touch from two threads
+    // at once (statics, SDL_ttf), so it runs on the main thread. Everything
+    // else can run alongside other slots' filters.
+    FILTER_SERIAL    = 1 << 3
+};
+
+// A filter that takes parameters, given the settings of the slot it's in
+typedef void (*ConfigFilterFunc)(const void *config, const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
+
+// Each slot a filter with parameters is in has settings of its own. They
+// start out zeroed; ConfigDefaults fills them in, then ConfigSetter is given
+// each key=value from the graph line, and returns 0 on success.
+typedef void (*ConfigDefaults)(void *config);
+typedef int  (*ConfigSetter)(void *config, const char *key, const char *value);
+
+// key=value pairs from a graph line, in order
+typedef std::vector<std::pair<std::string, std::string> > FilterParams;
+
+// Everything needed to build a filter, short of where it goes
+struct FilterInfo {
+    FilterInfo() : f(0), configured(0), flags(0), config_size(0), defaults(0), set(0), rows(0), halo(0) {};
+    FilterInfo(FilterFunc f, uint32_t flags) : f(f), configured(0), flags(flags), config_size(0), defaults(0), set(0), rows(0), halo(0) {};
+    /**
+     * A filter with parameters
+     * @param size      bytes of settings each slot gets
+     * @param defaults  May be NULL, to leave them zeroed
+     */
+    FilterInfo(ConfigFilterFunc f, uint32_t flags, size_t size, ConfigDefaults defaults, ConfigSetter set) :
+        f(0), configured(f), flags(flags), config_size(size), defaults(defaults), set(set), rows(0), halo(0) {};
+    /**
+     * Add a kernel, for when the input is already in (or is cheaper as) in
+     * @param rows  k for a band of rows, if it can be split like f
+     */
+    FilterInfo& overload(PixelFormat in, PixelFormat out, KernelFunc k, KernelRowsFunc rows = NULL)
+    {
+        kernels.push_back(Kernel(in, out, k, rows));
+        return *this;
+    }
+
+    /**
+     * Let a filter that isn't point-wise run in bands of rows, side by side
+     * (point-wise ones already can). It's also only rerun on the rows that
+     * changed and those within its halo of them.
+     * @param halo  how many rows above and below a band it reads
+     * @param r     f for a band of rows
+     */
+    FilterInfo& parallel_rows(uint32_t halo, RowsFunc r)
+    {
+        this->halo = halo;
+        rows = r;
+        return *this;
+    }
+
+    /**
+     * Make a slot's settings: its defaults, then params in order
+     * @param config    the settings (config_size bytes)
+     * @return          the params the filter wouldn't take, which are skipped
+     */
+    FilterParams configure(const FilterParams &params, std::vector<byte> &config) const;
+
+    // The filter: f, or for one with parameters, configured
+    FilterFunc f;
+    ConfigFilterFunc configured;
+    uint32_t flags;
+    // Parameters the filter takes beyond the generic ones, and how big its
+    // settings are and how to make them
+    std::vector<std::string> params;
+    size_t config_size;
+    ConfigDefaults defaults;
+    ConfigSetter set;
+    // Other versions of f, for other formats. flags apply to them too.
+    std::vector<Kernel> kernels;
+    // f for a band of rows (NULL: f only does whole frames, unless it's
+    // point-wise), and the rows beyond a band it reads
+    RowsFunc rows;
+    uint32_t halo;
+};
+
+// Maps filter names, as used in graph files, to filters
+class FilterRegistry
+{
+    public:
+        /** The registry, with the built-in filters already in it */
+        static FilterRegistry& get(void);
+
+        /** Add a filter, replacing any with the same name */
+        void add(const std::string &name, const FilterInfo &info);
+
+        void remove(const std::string &name);
+
+        bool has(const std::string &name) const;
+
+        /**
+         * Look up a filter
+         * @param name  the filter's name
+         * @throws      ArgumentError if there's no such filter
+         */
+        const FilterInfo& find(const std::string &name) const;
+
+        std::vector<std::string> names(void) const;
+
+    private:
+        FilterRegistry();
+        explicit FilterRegistry(const FilterRegistry&);
+        FilterRegistry& operator=(const FilterRegistry&);
+
+        std::map<std::string, FilterInfo> filters;
+};
+
+#endif
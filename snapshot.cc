@@ -0,0 +1,318 @@
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cctype>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "global.h"
+#include "snapshot.h"
+#include "utils/io.h"
+#include "video/convert.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    // The biggest stored deflate block
+    const size_t block_max = 65535;
+
+    uint32_t crc_table[256];
+
+    void make_crc_table(void)
+    {
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (uint32_t k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            crc_table[n] = c;
+        }
+    }
+
+    // Start from 0xffffffff, and flip the bits of the result
+    uint32_t crc(uint32_t c, const byte *p, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            c = crc_table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+        return c;
+    }
+
+    uint32_t adler32(const byte *p, size_t n)
+    {
+        uint32_t a = 1, b = 0;
+        while (n)
+        {
+            // The most bytes before b can overflow
+            const size_t run = min<size_t>(n, 5552);
+            for (size_t i = 0; i < run; ++i)
+            {
+                a += p[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            p += run;
+            n -= run;
+        }
+        return (b << 16) | a;
+    }
+
+    void put32(vector<byte> &v, uint32_t x)
+    {
+        v.push_back(x >> 24);
+        v.push_back(x >> 16);
+        v.push_back(x >> 8);
+        v.push_back(x);
+    }
+
+    // A whole chunk whose data is already in v, after its length and type
+    void end_chunk(vector<byte> &v, size_t type_at)
+    {
+        put32(v, ~crc(0xffffffff, &v[type_at], v.size() - type_at));
+    }
+}
+
+SnapshotFormat snapshotByName(const string &name)
+{
+    if (name == "ppm")
+        return SNAPSHOT_PPM;
+    if (name == "png")
+        return SNAPSHOT_PNG;
+    throw ArgumentError("Unknown screenshot format " + name);
+}
+
+SnapshotWriter::SnapshotWriter(const string &prefix, SnapshotFormat format, uint32_t buffers) :
+    prefix(prefix), format(format), pool(buffers), next(0), running(false), stopping(false)
+{
+    make_crc_table();
+    for (uint32_t i = 0; i < buffers; ++i)
+        free.push_back(i);
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&waiting, NULL);
+}
+
+SnapshotWriter::~SnapshotWriter(void)
+{
+    if (running)
+    {
+        pthread_mutex_lock(&lock);
+        stopping = true;
+        pthread_cond_signal(&waiting);
+        pthread_mutex_unlock(&lock);
+        pthread_join(thread, NULL);
+    }
+    pthread_cond_destroy(&waiting);
+    pthread_mutex_destroy(&lock);
+}
+
+void SnapshotWriter::setFormat(SnapshotFormat format)
+{
+    pthread_mutex_lock(&lock);
+    this->format = format;
+    pthread_mutex_unlock(&lock);
+}
+
+bool SnapshotWriter::take(const Pixel *pixels, uint32_t width, uint32_t height, size_t pitch)
+{
+    Context c("When queueing a snapshot");
+    pthread_mutex_lock(&lock);
+    if (free.empty())
+    {
+        pthread_mutex_unlock(&lock);
+        return false;
+    }
+    // The writer only starts once there's something to write
+    if (unlikely(!running))
+    {
+        if (pthread_create(&thread, NULL, run, this) != 0)
+        {
+            pthread_mutex_unlock(&lock);
+            throw GeneralError(DEBUG_HERE, "Couldn't start the snapshot writer");
+        }
+        running = true;
+    }
+    const uint32_t i = free.back();
+    free.pop_back();
+    Shot &s = pool[i];
+    s.format = format;
+    pthread_mutex_unlock(&lock);
+
+    // The slot is ours until it's queued
+    s.width  = width;
+    s.height = height;
+    const size_t pad = s.format == SNAPSHOT_PNG, row = pad + size_t(width) * 3;
+    s.rgb.resize(row * height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        byte *o = &s.rgb[y*row];
+        if (pad)
+            *o++ = 0;
+        bgra_to_rgb24(reinterpret_cast<const Pixel*>(reinterpret_cast<const byte*>(pixels) + y*pitch), o, width);
+    }
+
+    pthread_mutex_lock(&lock);
+    queued.push_back(i);
+    pthread_cond_signal(&waiting);
+    pthread_mutex_unlock(&lock);
+    return true;
+}
+
+void* SnapshotWriter::run(void *self)
+{
+    static_cast<SnapshotWriter*>(self)->writeAll();
+    return NULL;
+}
+
+void SnapshotWriter::writeAll(void)
+{
+    scan();
+    for (;;)
+    {
+        pthread_mutex_lock(&lock);
+        while (queued.empty() && !stopping)
+            pthread_cond_wait(&waiting, &lock);
+        // Anything still queued gets written before stopping
+        if (queued.empty())
+        {
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+        const uint32_t i = queued.front();
+        queued.pop_front();
+        pthread_mutex_unlock(&lock);
+
+        try {
+            write(pool[i]);
+        } catch (const Exception &e) {
+            cerr << e.message() << endl;
+        }
+
+        pthread_mutex_lock(&lock);
+        free.push_back(i);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void SnapshotWriter::scan(void)
+{
+    const size_t slash = prefix.rfind('/');
+    const string dir  = slash == string::npos ? "." : slash == 0 ? "/" : prefix.substr(0, slash);
+    const string base = slash == string::npos ? prefix : prefix.substr(slash + 1);
+
+    // If the directory can't be read, creating the files will say why
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    struct dirent *e;
+    while ((e = readdir(d)))
+    {
+        if (strncmp(e->d_name, base.c_str(), base.size()) != 0)
+            continue;
+        const char *number = e->d_name + base.size();
+        char *end;
+        const unsigned long n = strtoul(number, &end, 10);
+        if (end != number && isdigit(*number) && (!strcmp(end, ".ppm") || !strcmp(end, ".png")))
+            next = max<uint32_t>(next, n + 1);
+    }
+    closedir(d);
+}
+
+int SnapshotWriter::create(const char *ext, string &name)
+{
+    // Something else may have taken a name since the scan; just move past it
+    for (;; ++next)
+    {
+        name = prefix + stringify(next) + ext;
+        int fd = open(name.c_str(), O_CREAT|O_EXCL|O_WRONLY, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
+        if (fd >= 0)
+        {
+            ++next;
+            return fd;
+        }
+        if (errno != EEXIST)
+            throw GeneralError(DEBUG_HERE, "Could not open screenshot file " + name + ": " + strerror(errno));
+    }
+}
+
+void SnapshotWriter::write(Shot &s)
+{
+    string name;
+    Context c("When writing a snapshot");
+    const int fd = create(s.format == SNAPSHOT_PNG ? ".png" : ".ppm", name);
+    Context c2("When writing " + name);
+
+    vector<iovec> iov;
+    string ppm;
+    vector<byte> head, blocks, tail;
+    if (s.format == SNAPSHOT_PPM)
+    {
+        ppm = "P6\n" + stringify(s.width) + " " + stringify(s.height) + "\n255\n";
+        iov.push_back(piece(ppm.data(), ppm.size()));
+        iov.push_back(piece(&s.rgb[0], s.rgb.size()));
+    }
+    else
+    {
+        static const byte signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        head.assign(signature, signature + 8);
+
+        put32(head, 13);
+        const size_t ihdr = head.size();
+        head.insert(head.end(), "IHDR", "IHDR" + 4);
+        put32(head, s.width);
+        put32(head, s.height);
+        // 8 bits, RGB, deflate, no filtering, not interlaced
+        const byte kind[5] = {8, 2, 0, 0, 0};
+        head.insert(head.end(), kind, kind + 5);
+        end_chunk(head, ihdr);
+
+        // One IDAT holding a zlib stream of stored blocks, which point
+        // straight at the rows
+        const size_t length = s.rgb.size(), count = (length + block_max - 1) / block_max;
+        put32(head, 2 + 5*count + length + 4);
+        const size_t idat = head.size();
+        head.insert(head.end(), "IDAT", "IDAT" + 4);
+        head.push_back(0x78);
+        head.push_back(0x01);
+        uint32_t sum = crc(0xffffffff, &head[idat], head.size() - idat);
+        iov.push_back(piece(&head[0], head.size()));
+
+        blocks.resize(5*count);
+        for (size_t b = 0; b < count; ++b)
+        {
+            const size_t at = b*block_max, n = min(block_max, length - at);
+            byte *h = &blocks[5*b];
+            h[0] = b + 1 == count;
+            h[1] = n;
+            h[2] = n >> 8;
+            h[3] = ~n;
+            h[4] = ~n >> 8;
+            sum = crc(crc(sum, h, 5), &s.rgb[at], n);
+            iov.push_back(piece(h, 5));
+            iov.push_back(piece(&s.rgb[at], n));
+        }
+
+        put32(tail, adler32(&s.rgb[0], length));
+        sum = crc(sum, &tail[0], 4);
+        put32(tail, ~sum);
+        put32(tail, 0);
+        const size_t iend = tail.size();
+        tail.insert(tail.end(), "IEND", "IEND" + 4);
+        end_chunk(tail, iend);
+        iov.push_back(piece(&tail[0], tail.size()));
+    }
+
+    try {
+        writev_all(fd, iov);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    if (close(fd) != 0)
+        throw GeneralError(DEBUG_HERE, string("Couldn't finish writing: ") + strerror(errno));
+}
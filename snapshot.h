@@ -0,0 +1,89 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <pthread.h>
+
+#include "global.h"
+
+enum SnapshotFormat
+{
+    SNAPSHOT_PPM,
+    // Uncompressed (stored deflate blocks), so it costs no more than a PPM
+    SNAPSHOT_PNG
+};
+
+/**
+ * Look a format up by name (ppm, png)
+ * @throw ArgumentError if there's no such format
+ */
+SnapshotFormat snapshotByName(const std::string &name);
+
+// Writes frames to numbered files (shot0.ppm, shot1.ppm, ...) without holding
+// up the caller. A frame is converted to RGB straight into a buffer from a
+// small pool, and a thread of its own writes it out, a whole file per writev.
+// Numbering starts after the highest file already there, so each shot just
+// takes the next number.
+class SnapshotWriter
+{
+    public:
+        /**
+         * @param prefix    path and name up to the number
+         * @param format    what to write
+         * @param buffers   how many frames can be waiting to be written
+         */
+        explicit SnapshotWriter(const std::string &prefix = "shot", SnapshotFormat format = SNAPSHOT_PPM, uint32_t buffers = 3);
+        /** Waits for everything queued to be written */
+        ~SnapshotWriter(void);
+
+        /**
+         * Queue a frame to be written
+         * @param pixels    the frame, in BGRA
+         * @param width     size in pixels
+         * @param height
+         * @param pitch     bytes from the start of one row to the next
+         * @return          false if every buffer is still waiting to be
+         *                  written, in which case the frame is dropped
+         */
+        bool take(const Pixel *pixels, uint32_t width, uint32_t height, size_t pitch);
+
+        /** Write frames taken from now on in another format */
+        void setFormat(SnapshotFormat format);
+
+    private:
+        struct Shot
+        {
+            SnapshotFormat format;
+            uint32_t width, height;
+            // RGB rows. PNG rows start with their filter type (0, none).
+            std::vector<byte> rgb;
+        };
+
+        static void* run(void *self);
+        void writeAll(void);
+        /** Write a shot out to the next free name */
+        void write(Shot &s);
+        /** Open the next free name for writing, and say what it was */
+        int create(const char *ext, std::string &name);
+        /** Find the highest number already used */
+        void scan(void);
+
+        const std::string prefix;
+        SnapshotFormat format;
+        std::vector<Shot> pool;
+        // Indices into pool. Only the writer thread touches next.
+        std::vector<uint32_t> free;
+        std::deque<uint32_t> queued;
+        uint32_t next;
+        bool running, stopping;
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t waiting;
+
+        explicit SnapshotWriter(const SnapshotWriter&);
+        SnapshotWriter& operator=(const SnapshotWriter&);
+};
+
+#endif
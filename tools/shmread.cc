@@ -0,0 +1,68 @@
+// Reads the frames glasses publishes to other processes, and says how well
+// they keep up. Build it with 'make tools', run glasses with -P 3 (say), and
+// then
+//     tools/glasses-shmread /glasses-3 [seconds]
+// Every frame is read through once, in place, like a real consumer would.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+#include "../global.h"
+#include "../utils/clock.h"
+#include "../video/framering.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        cerr << "Usage: glasses-shmread <ring name, like /glasses-3> [seconds]" << endl;
+        return 1;
+    }
+    const double seconds = argc == 3 ? strtod(argv[2], NULL) : 10;
+
+    try {
+        FrameRingReader ring(argv[1]);
+        const size_t bytes = frameBytes(ring.getFormat(), ring.getWidth(), ring.getHeight());
+        cout << argv[1] << ": " << ring.getWidth() << "x" << ring.getHeight() << " "
+             << formatInfo(ring.getFormat()).name << endl;
+
+        const uint64_t start = monotonic_ns(), end = start + uint64_t(seconds * 1e9);
+        uint64_t report = start + 1000000000ULL, frames = 0, latency = 0;
+        uint32_t sum = 0;
+        for (uint64_t now = start; now < end; now = monotonic_ns())
+        {
+            const byte *frame = ring.acquire(100);
+            if (frame)
+            {
+                // A byte a cache line is enough to pull the whole frame through
+                for (size_t i = 0; i < bytes; i += 64)
+                    sum += frame[i];
+                ring.release();
+                latency += monotonic_ns() - ring.getTime();
+                ++frames;
+            }
+
+            if (now >= report)
+            {
+                cout << fixed << setprecision(1)
+                     << frames << " frames/s, "
+                     << frames * bytes / 1e6 << " MB/s, "
+                     << (frames ? latency / frames / 1e3 : 0) << " us from capture to done, "
+                     << ring.getSkipped() << " skipped, "
+                     << ring.getTorn() << " torn" << endl;
+                report += 1000000000ULL;
+                frames = latency = 0;
+            }
+        }
+        cout << ring.getTaken() << " frames taken, " << ring.getSkipped() << " skipped, "
+             << ring.getTorn() << " torn (checksum " << sum << ")" << endl;
+    } catch (const Exception &e) {
+        cerr << e.message() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
+
+namespace novas0x2a
+{
+    // Nanoseconds on the monotonic clock (which doesn't jump when the date changes)
+    inline uint64_t monotonic_ns(void)
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return uint64_t(t.tv_sec) * 1000000000ULL + t.tv_nsec;
+    }
+
+    // Sleep until the monotonic clock reads ns
+    inline void sleep_until(uint64_t ns)
+    {
+        struct timespec t;
+        t.tv_sec  = ns / 1000000000ULL;
+        t.tv_nsec = ns % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR)
+            ;
+    }
+}
+
+#endif
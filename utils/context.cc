@@ -11,7 +11,8 @@ using namespace novas0x2a;
 
 namespace
 {
-    static std::list<std::string> *context = 0;
+    // One stack per thread
+    static __thread std::list<std::string> *context = 0;
 }
 
 Context::Context(const std::string & s)
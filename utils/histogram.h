@@ -0,0 +1,99 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <stdint.h>
+
+namespace novas0x2a
+{
+    // Counts durations into power-of-two buckets of microseconds: bucket 0
+    // is under 2us, and bucket n from 2^n up to 2^(n+1). Cheap enough to
+    // add to every frame, and fine enough to see where the time goes.
+    class LatencyHistogram
+    {
+        public:
+            static const uint32_t buckets = 32;
+
+            LatencyHistogram(void) {reset();};
+
+            void reset(void)
+            {
+                for (uint32_t i = 0; i < buckets; ++i)
+                    counts[i] = 0;
+                total = sum = worst = 0;
+            }
+
+            // Count a duration, in nanoseconds
+            void add(uint64_t ns)
+            {
+                uint64_t us = ns / 1000;
+                uint32_t b = 0;
+                while (us > 1 && b < buckets - 1)
+                {
+                    us >>= 1;
+                    ++b;
+                }
+                ++counts[b];
+                ++total;
+                sum += ns;
+                if (ns > worst)
+                    worst = ns;
+            }
+
+            inline uint64_t getCount(void) const {return total;};
+            inline uint64_t getMean(void)  const {return total ? sum / total : 0;};
+            inline uint64_t getWorst(void) const {return worst;};
+
+            // The top of the bucket that p (0 to 1) of the durations fall
+            // under, in nanoseconds
+            uint64_t getPercentile(double p) const
+            {
+                const uint64_t want = uint64_t(p * total + 0.5);
+                uint64_t seen = 0;
+                for (uint32_t b = 0; b < buckets; ++b)
+                {
+                    seen += counts[b];
+                    if (seen >= want && seen)
+                        return (uint64_t(2) << b) * 1000;
+                }
+                return worst;
+            }
+
+            // One line of summary, then a bar for every bucket used
+            void print(std::ostream &os, const std::string &name) const
+            {
+                os << name << ": " << total << " frames";
+                if (!total)
+                {
+                    os << std::endl;
+                    return;
+                }
+                os << std::fixed << std::setprecision(2)
+                   << ", mean " << getMean() / 1e6
+                   << " ms, 50% under " << getPercentile(0.5) / 1e6
+                   << " ms, 99% under " << getPercentile(0.99) / 1e6
+                   << " ms, worst " << worst / 1e6 << " ms" << std::endl;
+
+                uint64_t most = 0;
+                for (uint32_t b = 0; b < buckets; ++b)
+                    if (counts[b] > most)
+                        most = counts[b];
+                for (uint32_t b = 0; b < buckets; ++b)
+                {
+                    if (!counts[b])
+                        continue;
+                    os << "  < " << std::setprecision(3) << std::setw(9) << (uint64_t(2) << b) / 1e3 << " ms "
+                       << std::setw(8) << counts[b] << " "
+                       << std::string(size_t(counts[b] * 40 / most), '#') << std::endl;
+                }
+            }
+
+        private:
+            uint64_t counts[buckets];
+            uint64_t total, sum, worst;
+    };
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef IO_H
+#define IO_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <sys/uio.h>
+
+#include "context.h"
+
+namespace novas0x2a
+{
+    // A piece of something to writev
+    inline iovec piece(const void *p, size_t n)
+    {
+        iovec v = {const_cast<void*>(p), n};
+        return v;
+    }
+
+    // writev until everything is out. Takes IOV_MAX at a time, and picks up
+    // after short writes. iov is used up along the way.
+    inline void writev_all(int fd, std::vector<iovec> &iov)
+    {
+        size_t i = 0;
+        while (i < iov.size())
+        {
+            const size_t count = std::min<size_t>(iov.size() - i, IOV_MAX);
+            ssize_t n = writev(fd, &iov[i], count);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw GeneralError(DEBUG_HERE, std::string("Couldn't write: ") + strerror(errno));
+            }
+            for (; i < iov.size() && size_t(n) >= iov[i].iov_len; ++i)
+                n -= iov[i].iov_len;
+            if (n)
+            {
+                iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + n;
+                iov[i].iov_len -= n;
+            }
+        }
+    }
+}
+
+#endif
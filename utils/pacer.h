@@ -0,0 +1,62 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+
+#include "clock.h"
+
+namespace novas0x2a
+{
+    // Keeps something happening at a steady rate, by the monotonic clock.
+    // Ticks are due at fixed times rather than a fixed time after the last
+    // one, so lateness doesn't add up; after a stall of more than a tick it
+    // starts again from now rather than rushing to catch up.
+    class Pacer
+    {
+        public:
+            // 0 Hz is unpaced: every tick is due straight away
+            explicit Pacer(double hz = 0) : period(0), next(0) {setRate(hz);};
+
+            void setRate(double hz)
+            {
+                period = hz > 0 ? uint64_t(1e9 / hz) : 0;
+                next = 0;
+            }
+
+            // Whether a tick is due at now. If it is, it's taken.
+            bool due(uint64_t now)
+            {
+                if (period && next && now < next)
+                    return false;
+                advance(now);
+                return true;
+            }
+
+            // Wait for the next tick, and take it
+            void wait(void)
+            {
+                if (!period)
+                    return;
+                const uint64_t now = monotonic_ns();
+                if (next && now < next)
+                    sleep_until(next);
+                advance(now);
+            }
+
+            // When the next tick is due (0: now)
+            inline uint64_t getNext(void) const {return next;};
+            inline uint64_t getPeriod(void) const {return period;};
+
+        private:
+            void advance(uint64_t now)
+            {
+                if (next == 0 || now > next + period)
+                    next = now;
+                next += period;
+            }
+
+            uint64_t period, next;
+    };
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <vector>
+#include <stdint.h>
+
+namespace novas0x2a
+{
+    // A fixed ring of preallocated slots passed from one producer thread to
+    // one consumer thread without locks. Each side only writes its own index
+    // and reads the other's, so a slot is handed over by a release store
+    // after it's filled (or emptied) and an acquire load before it's used.
+    template <typename T>
+    class SpscRing
+    {
+        public:
+            explicit SpscRing(uint32_t size) : slots(size + 1), head(0), tail(0) {};
+
+            // Producer: the slot to fill next, or NULL if the ring is full
+            T* claim(void)
+            {
+                const uint32_t next = (tail + 1) % slots.size();
+                if (next == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+                    return NULL;
+                return &slots[tail];
+            }
+
+            // Producer: hand the claimed slot over
+            void publish(void)
+            {
+                __atomic_store_n(&tail, (tail + 1) % slots.size(), __ATOMIC_RELEASE);
+            }
+
+            // Consumer: the oldest filled slot, or NULL if there isn't one
+            T* front(void)
+            {
+                if (head == __atomic_load_n(&tail, __ATOMIC_ACQUIRE))
+                    return NULL;
+                return &slots[head];
+            }
+
+            // Consumer: give the front slot back to be filled again
+            void pop(void)
+            {
+                __atomic_store_n(&head, (head + 1) % slots.size(), __ATOMIC_RELEASE);
+            }
+
+            // Producer: every slot, to set them up before anything's passed
+            std::vector<T>& all(void) {return slots;};
+
+        private:
+            // One slot is always empty, to tell full from empty
+            std::vector<T> slots;
+            // head: consumer's next slot. tail: producer's next slot.
+            // Apart, so the two sides don't fight over a cache line.
+            uint32_t head;
+            char pad[64];
+            uint32_t tail;
+
+            SpscRing(const SpscRing&);
+            SpscRing& operator=(const SpscRing&);
+    };
+}
+
+#endif
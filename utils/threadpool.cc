@@ -0,0 +1,268 @@
+#include <exception>
+#include <sched.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    // The pool the calling thread belongs to (if any), and its deque there
+    __thread TaskPool *current_pool = NULL;
+    __thread uint32_t current_index = 0;
+
+    // How to make the shared pool, and whether it's been made
+    uint32_t shared_threads = 0;
+    bool shared_pin = false, shared_made = false;
+}
+
+TaskGroup::TaskGroup(TaskPool &pool) : pool(pool), pending(0), failed(false)
+{
+}
+
+TaskGroup::~TaskGroup(void)
+{
+    try {
+        wait();
+    } catch (const Exception &) {
+        // Whoever let go of the group without waiting was already failing
+    }
+}
+
+void TaskGroup::spawn(Task *t)
+{
+    __atomic_add_fetch(&pending, 1, __ATOMIC_SEQ_CST);
+    TaskPool::Item item = {t, this};
+    pool.push(item);
+}
+
+void TaskGroup::wait(void)
+{
+    while (__atomic_load_n(&pending, __ATOMIC_SEQ_CST) > 0)
+    {
+        // Help out rather than block: whatever's taken is either one of ours
+        // or holding up somebody else
+        TaskPool::Item item;
+        if (pool.take(item))
+            pool.execute(item);
+        else
+            pool.idle(this);
+    }
+    if (failed)
+    {
+        failed = false;
+        throw TaskError(error);
+    }
+}
+
+TaskPool::TaskPool(uint32_t threads, bool pin) : queued(0), sleepers(0), stopping(false)
+{
+    Context c("While starting the task pool");
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads == 0)
+        threads = cores > 0 ? cores : 1;
+
+    pthread_mutex_init(&sleep_lock, NULL);
+    pthread_cond_init(&sleep, NULL);
+
+    // Deque 0 is for threads that aren't the pool's, so it has no thread
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        Worker *w = new Worker;
+        w->pool  = this;
+        w->index = i;
+        pthread_mutex_init(&w->lock, NULL);
+        workers.push_back(w);
+    }
+    for (uint32_t i = 1; i < threads; ++i)
+    {
+        Worker *w = workers[i];
+        if (pthread_create(&w->thread, NULL, run, w) != 0)
+        {
+            // Fewer threads still get the work done
+            for (uint32_t j = i; j < threads; ++j)
+            {
+                pthread_mutex_destroy(&workers[j]->lock);
+                delete workers[j];
+            }
+            workers.resize(i);
+            break;
+        }
+        if (pin && cores > 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % cores, &set);
+            pthread_setaffinity_np(w->thread, sizeof(set), &set);
+        }
+    }
+}
+
+TaskPool::~TaskPool(void)
+{
+    pthread_mutex_lock(&sleep_lock);
+    stopping = true;
+    pthread_cond_broadcast(&sleep);
+    pthread_mutex_unlock(&sleep_lock);
+
+    for (uint32_t i = 0; i < workers.size(); ++i)
+    {
+        if (i > 0)
+            pthread_join(workers[i]->thread, NULL);
+        pthread_mutex_destroy(&workers[i]->lock);
+        delete workers[i];
+    }
+    pthread_cond_destroy(&sleep);
+    pthread_mutex_destroy(&sleep_lock);
+}
+
+TaskPool& TaskPool::get(void)
+{
+    static TaskPool shared(shared_threads, shared_pin);
+    __atomic_store_n(&shared_made, true, __ATOMIC_RELAXED);
+    return shared;
+}
+
+void TaskPool::configure(uint32_t threads, bool pin)
+{
+    if (__atomic_load_n(&shared_made, __ATOMIC_RELAXED))
+        throw GeneralError(DEBUG_HERE, "The task pool is already running");
+    shared_threads = threads;
+    shared_pin     = pin;
+}
+
+uint32_t TaskPool::self(void) const
+{
+    return current_pool == this ? current_index : 0;
+}
+
+void TaskPool::push(const Item &item)
+{
+    Worker &w = *workers[self()];
+    pthread_mutex_lock(&w.lock);
+    w.items.push_back(item);
+    pthread_mutex_unlock(&w.lock);
+
+    __atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&sleep_lock);
+        pthread_cond_signal(&sleep);
+        pthread_mutex_unlock(&sleep_lock);
+    }
+}
+
+bool TaskPool::take(Item &item)
+{
+    if (!__atomic_load_n(&queued, __ATOMIC_SEQ_CST))
+        return false;
+
+    const uint32_t me = self(), n = workers.size();
+    for (uint32_t k = 0; k < n; ++k)
+    {
+        Worker &w = *workers[(me + k) % n];
+        pthread_mutex_lock(&w.lock);
+        if (w.items.empty())
+        {
+            pthread_mutex_unlock(&w.lock);
+            continue;
+        }
+        // Our own newest, or somebody else's oldest
+        if (k == 0)
+        {
+            item = w.items.back();
+            w.items.pop_back();
+        }
+        else
+        {
+            item = w.items.front();
+            w.items.pop_front();
+        }
+        pthread_mutex_unlock(&w.lock);
+        __atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+        return true;
+    }
+    return false;
+}
+
+void TaskPool::execute(const Item &item)
+{
+    TaskGroup &g = *item.group;
+    string failure;
+    bool failed = false;
+    try {
+        item.task->run();
+    } catch (const Exception &e) {
+        failed = true;
+        failure = e.message();
+    } catch (const std::exception &e) {
+        failed = true;
+        failure = e.what();
+    }
+
+    if (failed)
+    {
+        pthread_mutex_lock(&sleep_lock);
+        if (!g.failed)
+        {
+            g.failed = true;
+            g.error  = failure;
+        }
+        pthread_mutex_unlock(&sleep_lock);
+    }
+
+    // The group can be gone as soon as this reaches 0, so it's the last
+    // thing touched
+    if (__atomic_sub_fetch(&g.pending, 1, __ATOMIC_SEQ_CST) == 0)
+        wake();
+}
+
+void TaskPool::idle(const TaskGroup *group)
+{
+    pthread_mutex_lock(&sleep_lock);
+    __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    while (!stopping && !__atomic_load_n(&queued, __ATOMIC_SEQ_CST) &&
+            (!group || __atomic_load_n(&group->pending, __ATOMIC_SEQ_CST) > 0))
+        pthread_cond_wait(&sleep, &sleep_lock);
+    __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&sleep_lock);
+}
+
+void TaskPool::wake(void)
+{
+    if (!__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST))
+        return;
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_broadcast(&sleep);
+    pthread_mutex_unlock(&sleep_lock);
+}
+
+void* TaskPool::run(void *worker)
+{
+    Worker &w = *static_cast<Worker*>(worker);
+    w.pool->work(w);
+    return NULL;
+}
+
+void TaskPool::work(Worker &w)
+{
+    current_pool  = this;
+    current_index = w.index;
+    for (;;)
+    {
+        Item item;
+        if (take(item))
+            execute(item);
+        else
+        {
+            pthread_mutex_lock(&sleep_lock);
+            const bool done = stopping;
+            pthread_mutex_unlock(&sleep_lock);
+            if (done)
+                return;
+            idle(NULL);
+        }
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "context.h"
+
+namespace novas0x2a
+{
+    class TaskPool;
+
+    // Some work for a TaskPool. It's run once, on whichever thread gets to it.
+    class Task
+    {
+        public:
+            virtual ~Task(void) {};
+            virtual void run(void) = 0;
+    };
+
+    // Tasks started together, to be waited for together. Tasks can start
+    // groups of their own and wait on them (fork/join, nested as deep as
+    // need be): a thread waiting on a group runs queued tasks meanwhile, so
+    // nothing sits blocked while there's work.
+    class TaskGroup
+    {
+        public:
+            explicit TaskGroup(TaskPool &pool);
+            /** Waits for anything still running, swallowing its errors */
+            ~TaskGroup(void);
+
+            /**
+             * Queue a task. It has to stay alive until wait returns.
+             * @param t     the task
+             */
+            void spawn(Task *t);
+
+            /**
+             * Run tasks until every one spawned in this group is done
+             * @throw TaskError if any of them threw, with its message
+             */
+            void wait(void);
+
+        private:
+            friend class TaskPool;
+
+            TaskPool &pool;
+            // Tasks spawned and not yet finished
+            uint32_t pending;
+            // The first failure, if there was one
+            bool failed;
+            std::string error;
+
+            explicit TaskGroup(const TaskGroup&);
+            TaskGroup& operator=(const TaskGroup&);
+    };
+
+    // A fixed set of threads, each with a deque of tasks. A thread pushes the
+    // tasks it spawns onto the back of its own deque and takes them off the
+    // back again, newest first, while they're still in cache; when it runs
+    // out, it steals the oldest task from another thread's front. Threads
+    // that aren't the pool's (the main loop's, say) share deque 0.
+    //
+    // There's one shared pool, TaskPool::get(), so that everything needing
+    // threads shares the same ones instead of each making its own and
+    // oversubscribing the cores.
+    class TaskPool
+    {
+        public:
+            /**
+             * @param threads   how many threads run tasks, counting whichever
+             *                  thread waits on a group (0: one per core)
+             * @param pin       tie each of the pool's threads to a core
+             */
+            explicit TaskPool(uint32_t threads = 0, bool pin = false);
+            ~TaskPool(void);
+
+            /** The shared pool, made on first use as configure said */
+            static TaskPool& get(void);
+
+            /**
+             * Say how to make the shared pool. Only works before its first use.
+             * @throw GeneralError if the pool already exists
+             */
+            static void configure(uint32_t threads, bool pin);
+
+            /** How many threads run tasks, counting the one waiting */
+            inline uint32_t getThreads(void) const {return workers.size();};
+
+        private:
+            friend class TaskGroup;
+
+            struct Item
+            {
+                Task *task;
+                TaskGroup *group;
+            };
+
+            struct Worker
+            {
+                TaskPool *pool;
+                uint32_t index;
+                pthread_t thread;
+                pthread_mutex_t lock;
+                std::deque<Item> items;
+            };
+
+            /** Queue on the calling thread's deque */
+            void push(const Item &item);
+            /** Take the calling thread's newest task, or else steal another's oldest */
+            bool take(Item &item);
+            /** Run a task, and finish it in its group */
+            void execute(const Item &item);
+            /** Sleep until there's work, or group (if any) is done */
+            void idle(const TaskGroup *group);
+            /** Wake sleepers, if there are any */
+            void wake(void);
+            /** Which deque the calling thread uses */
+            uint32_t self(void) const;
+
+            static void* run(void *worker);
+            void work(Worker &w);
+
+            std::vector<Worker*> workers;
+            // Tasks queued and not yet taken, threads asleep, and shutdown
+            uint32_t queued, sleepers;
+            bool stopping;
+            pthread_mutex_t sleep_lock;
+            pthread_cond_t sleep;
+
+            explicit TaskPool(const TaskPool&);
+            TaskPool& operator=(const TaskPool&);
+    };
+
+    class TaskError : public Exception
+    {
+        public:
+            TaskError(const std::string& our_message) throw ():
+                Exception(our_message) {};
+    };
+}
+
+#endif
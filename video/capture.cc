@@ -0,0 +1,236 @@
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include "../global.h"
+#include "../utils/clock.h"
+#include "capture.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    off_t align_up(off_t x)
+    {
+        return (x + capture_align - 1) & ~off_t(capture_align - 1);
+    }
+
+    // pwrite until it's all out
+    void pwrite_all(int fd, const void *p, size_t n, off_t at)
+    {
+        const byte *b = static_cast<const byte*>(p);
+        while (n)
+        {
+            const ssize_t done = pwrite(fd, b, n, at);
+            if (done < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw CaptureError(string("Couldn't write the capture: ") + strerror(errno));
+            }
+            b  += done;
+            n  -= done;
+            at += done;
+        }
+    }
+}
+
+CaptureTee::CaptureTee(VideoDevice &source, const string &path, bool compress)
+    : source(source), path(path), compress(compress), fd(-1), end(sizeof(CaptureHeader)), start(0)
+{
+    Context c("While starting a capture to " + path);
+#ifndef HAVE_LZ4
+    if (compress)
+        cerr << "Not built with LZ4, so " << path << " won't be compressed" << endl;
+#endif
+    fd = open(path.c_str(), O_CREAT|O_TRUNC|O_WRONLY, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
+    if (fd < 0)
+        throw CaptureError("Could not create " + path + " (" + strerror(errno) + ")");
+    follow();
+}
+
+CaptureTee::~CaptureTee(void)
+{
+    Context c("While finishing the capture to " + path);
+    try {
+        finish();
+    } catch (const Exception &e) {
+        cerr << e.message() << endl;
+    }
+    close(fd);
+}
+
+void CaptureTee::follow(void)
+{
+    width  = source.getWidth();
+    height = source.getHeight();
+    depth  = source.getDepth();
+    format = source.getFormat();
+}
+
+void CaptureTee::setParams(uint32_t width, uint32_t height, PixelFormat format)
+{
+    if (!index.empty())
+        throw CaptureError("Can't change the frame size or format in the middle of a capture");
+    source.setParams(width, height, format);
+    follow();
+}
+
+void CaptureTee::append(const byte *frame)
+{
+    // Frames are kept at the times they were captured, where the source knows
+    const uint64_t stamp = source.getTimestamp();
+    const uint64_t now = stamp ? stamp : monotonic_ns();
+    // The size and format are settled now, so a capture cut short can say
+    // what its frames are
+    if (index.empty())
+    {
+        start = now;
+        header(0);
+    }
+
+    CaptureRecord r;
+    memset(&r, 0, sizeof(r));
+    memcpy(r.magic, CAPTURE_RECORD_MAGIC, sizeof(r.magic));
+    CaptureEntry &e = r.entry;
+    e.time = now - start;
+
+    // A repeat just points at what's already there
+    if (!index.empty() && !source.frameChanged())
+    {
+        e.offset = index.back().offset;
+        e.size   = index.back().size;
+        e.flags  = index.back().flags;
+        r.next   = align_up(end + sizeof(r));
+    }
+    else
+    {
+        const size_t bytes = frameBytes(format, width, height);
+        e.offset = align_up(end + sizeof(r));
+        e.size   = bytes;
+        e.flags  = 0;
+        const byte *data = frame;
+#ifdef HAVE_LZ4
+        if (compress)
+        {
+            packed.resize(LZ4_compressBound(bytes));
+            const int n = LZ4_compress_default(reinterpret_cast<const char*>(frame), reinterpret_cast<char*>(&packed[0]), bytes, packed.size());
+            // Frames that don't shrink are stored as they are
+            if (n > 0 && size_t(n) < bytes)
+            {
+                e.size  = n;
+                e.flags = CAPTURE_LZ4;
+                data    = &packed[0];
+            }
+        }
+#endif
+        pwrite_all(fd, data, e.size, e.offset);
+        r.next = align_up(e.offset + e.size);
+    }
+
+    // Only once the data is all there
+    pwrite_all(fd, &r, sizeof(r), end);
+    end = r.next;
+    index.push_back(e);
+}
+
+void CaptureTee::header(uint64_t at)
+{
+    CaptureHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CAPTURE_MAGIC, sizeof(h.magic));
+    h.width  = width;
+    h.height = height;
+    h.format = format;
+    h.frames = at ? index.size() : 0;
+    h.index  = at;
+    pwrite_all(fd, &h, sizeof(h), 0);
+}
+
+void CaptureTee::finish(void)
+{
+    if (!index.empty())
+        pwrite_all(fd, &index[0], index.size() * sizeof(CaptureEntry), end);
+    header(end);
+}
+
+void CaptureTee::getFrame(byte *buf)
+{
+    source.getFrame(buf);
+    append(buf);
+}
+
+const byte* CaptureTee::acquireFrame(void)
+{
+    const byte *frame = source.acquireFrame();
+    if (frame)
+        append(frame);
+    return frame;
+}
+
+void CaptureTee::releaseFrame(void)
+{
+    source.releaseFrame();
+}
+
+bool CaptureTee::frameChanged(void) const
+{
+    return source.frameChanged();
+}
+
+uint64_t CaptureTee::getTimestamp(void) const
+{
+    return source.getTimestamp();
+}
+
+uint16_t CaptureTee::getBrightness(void) const
+{
+    return source.getBrightness();
+}
+uint16_t CaptureTee::getHue(void) const
+{
+    return source.getHue();
+}
+uint16_t CaptureTee::getColour(void) const
+{
+    return source.getColour();
+}
+uint16_t CaptureTee::getContrast(void) const
+{
+    return source.getContrast();
+}
+uint16_t CaptureTee::getWhiteness(void) const
+{
+    return source.getWhiteness();
+}
+
+void CaptureTee::setBrightness(uint16_t x)
+{
+    source.setBrightness(x);
+}
+void CaptureTee::setHue(uint16_t x)
+{
+    source.setHue(x);
+}
+void CaptureTee::setColour(uint16_t x)
+{
+    source.setColour(x);
+}
+void CaptureTee::setContrast(uint16_t x)
+{
+    source.setContrast(x);
+}
+void CaptureTee::setWhiteness(uint16_t x)
+{
+    source.setWhiteness(x);
+}
@@ -0,0 +1,139 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "../global.h"
+#include "videodevice.h"
+
+// Capture files (*.cap) hold the frames a device delivered, exactly as it
+// delivered them, with when it delivered them, so a run can be replayed
+// frame for frame. All fields are native-endian.
+//
+//   CaptureHeader
+//   for each frame, a CaptureRecord, then the frame's data
+//   CaptureEntry for each frame (the index)
+//
+// Records and frame data each start on a capture_align boundary. A frame
+// the device repeated (frameChanged said no) has a record that points at
+// the data of the one before, rather than storing it again.
+//
+// The index is only written when the capture is closed. One that never was
+// (the program crashed, or was killed) is still playable: the records hold
+// the same entries, and each is written after its frame's data, so every
+// record found has a whole frame behind it.
+
+#define CAPTURE_MAGIC "GLASCAP1"
+#define CAPTURE_RECORD_MAGIC "GLASFRM1"
+
+// Frames start on this boundary, so a lent frame is as aligned as SIMD likes
+static const uint32_t capture_align = 64;
+
+enum
+{
+    // The frame is LZ4 compressed (only ever written if it came out smaller)
+    CAPTURE_LZ4 = 1 << 0
+};
+
+struct CaptureHeader
+{
+    char magic[8];
+    uint32_t width, height;
+    // PixelFormat of every frame
+    uint32_t format;
+    uint32_t frames;
+    // Where the index starts. 0 until the capture is closed.
+    uint64_t index;
+    byte reserved[32];
+};
+
+struct CaptureEntry
+{
+    // Where the frame's data is, and how many bytes of it there are
+    uint64_t offset;
+    uint32_t size;
+    // CAPTURE_* flags
+    uint32_t flags;
+    // Nanoseconds since the first frame
+    uint64_t time;
+};
+
+struct CaptureRecord
+{
+    char magic[8];
+    // The frame's index entry
+    CaptureEntry entry;
+    // Where the next record goes
+    uint64_t next;
+    byte reserved[24];
+};
+
+// Passes frames through from another device, writing each one to a capture
+// file on the way. Everything else is the other device's business.
+class CaptureTee : public VideoDevice
+{
+    public:
+        /**
+         * @param source    the device to capture. It has to outlive the tee.
+         * @param path      capture file to create (or replace)
+         * @param compress  LZ4 compress frames, where that makes them smaller.
+         *                  Only if built with HAVE_LZ4.
+         */
+        CaptureTee(VideoDevice &source, const std::string &path, bool compress = false);
+        /** Finishes the file with its index */
+        ~CaptureTee(void);
+
+        /** A capture holds one size and format, so this only works before the first frame */
+        void setParams(uint32_t width, uint32_t height, PixelFormat format);
+        void getFrame(byte *buf);
+        const byte* acquireFrame(void);
+        void releaseFrame(void);
+        bool frameChanged(void) const;
+        uint64_t getTimestamp(void) const;
+
+        uint16_t getBrightness(void) const;
+        uint16_t getHue(void)        const;
+        uint16_t getColour(void)     const;
+        uint16_t getContrast(void)   const;
+        uint16_t getWhiteness(void)  const;
+
+        void setBrightness(uint16_t);
+        void setHue(uint16_t);
+        void setColour(uint16_t);
+        void setContrast(uint16_t);
+        void setWhiteness(uint16_t);
+
+    private:
+        /** Take on the source's size and format */
+        void follow(void);
+        /** Add a frame to the file */
+        void append(const byte *frame);
+        /** Write the header, saying where the index is (0: not written yet) */
+        void header(uint64_t at);
+        /** Write the index and the final header */
+        void finish(void);
+
+        VideoDevice &source;
+        const std::string path;
+        const bool compress;
+        int fd;
+        // Where the next frame's record goes, and when the first one came
+        off_t end;
+        uint64_t start;
+        std::vector<CaptureEntry> index;
+        std::vector<byte> packed;
+
+        explicit CaptureTee(const CaptureTee&);
+        CaptureTee& operator=(const CaptureTee&);
+};
+
+class CaptureError : public VideoError
+{
+    public:
+        CaptureError(const std::string& our_message) throw ():
+            VideoError(our_message) {};
+};
+
+#endif
@@ -0,0 +1,515 @@
+#include <cstring>
+
+#include "convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef HAVE_CPU_DISPATCH
+#include <tmmintrin.h>
+#endif
+
+// RGB() leaves alpha at 1, and so do the converters
+static const uint32_t alpha = 0x01000000;
+
+namespace
+{
+    void rgb24_to_bgra_c(const byte *in, Pixel *out, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; ++i, in += 3)
+            out[i] = RGB(in[0], in[1], in[2]);
+    }
+
+#ifdef HAVE_CPU_DISPATCH
+    // 16 pixels a go: four overlapping 12-byte loads, each shuffled into four
+    // pixels. The last load reads 4 bytes past the 16 pixels, hence the slack.
+    __attribute__((target("ssse3")))
+    void rgb24_to_bgra_ssse3(const byte *in, Pixel *out, uint32_t count)
+    {
+        const __m128i shuf = _mm_setr_epi8(2,1,0,-1, 5,4,3,-1, 8,7,6,-1, 11,10,9,-1);
+        const __m128i a    = _mm_set1_epi32(alpha);
+        uint32_t i = 0;
+        for (; i + 18 <= count; i += 16, in += 48)
+        {
+            __m128i *o = reinterpret_cast<__m128i*>(out + i);
+            _mm_storeu_si128(o+0, _mm_or_si128(a, _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in +  0)), shuf)));
+            _mm_storeu_si128(o+1, _mm_or_si128(a, _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 12)), shuf)));
+            _mm_storeu_si128(o+2, _mm_or_si128(a, _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 24)), shuf)));
+            _mm_storeu_si128(o+3, _mm_or_si128(a, _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 36)), shuf)));
+        }
+        rgb24_to_bgra_c(in, out + i, count - i);
+    }
+#endif
+}
+
+void rgb24_to_bgra(const byte *in, Pixel *out, uint32_t count)
+{
+#ifdef HAVE_CPU_DISPATCH
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    if (likely(ssse3))
+        return rgb24_to_bgra_ssse3(in, out, count);
+#endif
+    rgb24_to_bgra_c(in, out, count);
+}
+
+namespace
+{
+    void bgra_to_rgb24_c(const Pixel *in, byte *out, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; ++i, out += 3)
+        {
+            out[0] = R(in[i]);
+            out[1] = G(in[i]);
+            out[2] = B(in[i]);
+        }
+    }
+
+#ifdef HAVE_CPU_DISPATCH
+    // The reverse of rgb24_to_bgra_ssse3: four pixels shuffle down to 12
+    // bytes, and each 16-byte store overlaps the next. The last store writes
+    // 4 bytes past the 16 pixels, hence the slack.
+    __attribute__((target("ssse3")))
+    void bgra_to_rgb24_ssse3(const Pixel *in, byte *out, uint32_t count)
+    {
+        const __m128i shuf = _mm_setr_epi8(2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1);
+        uint32_t i = 0;
+        for (; i + 18 <= count; i += 16, out += 48)
+        {
+            const __m128i *p = reinterpret_cast<const __m128i*>(in + i);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out +  0), _mm_shuffle_epi8(_mm_loadu_si128(p+0), shuf));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_shuffle_epi8(_mm_loadu_si128(p+1), shuf));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 24), _mm_shuffle_epi8(_mm_loadu_si128(p+2), shuf));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 36), _mm_shuffle_epi8(_mm_loadu_si128(p+3), shuf));
+        }
+        bgra_to_rgb24_c(in + i, out, count - i);
+    }
+#endif
+}
+
+void bgra_to_rgb24(const Pixel *in, byte *out, uint32_t count)
+{
+#ifdef HAVE_CPU_DISPATCH
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    if (likely(ssse3))
+        return bgra_to_rgb24_ssse3(in, out, count);
+#endif
+    bgra_to_rgb24_c(in, out, count);
+}
+
+void gray8_to_bgra(const byte *in, Pixel *out, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128i a    = _mm_set1_epi32(alpha);
+    const __m128i mask = _mm_set1_epi32(0x00ffffff);
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i g  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo = _mm_unpacklo_epi8(g, g), hi = _mm_unpackhi_epi8(g, g);
+        __m128i *o = reinterpret_cast<__m128i*>(out + i);
+        _mm_storeu_si128(o+0, _mm_or_si128(a, _mm_and_si128(mask, _mm_unpacklo_epi16(lo, lo))));
+        _mm_storeu_si128(o+1, _mm_or_si128(a, _mm_and_si128(mask, _mm_unpackhi_epi16(lo, lo))));
+        _mm_storeu_si128(o+2, _mm_or_si128(a, _mm_and_si128(mask, _mm_unpacklo_epi16(hi, hi))));
+        _mm_storeu_si128(o+3, _mm_or_si128(a, _mm_and_si128(mask, _mm_unpackhi_epi16(hi, hi))));
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = RGB(in[i], in[i], in[i]);
+}
+
+namespace
+{
+    inline byte clamp(int32_t x)
+    {
+        return x < 0 ? 0 : x > 255 ? 255 : x;
+    }
+
+    // BT.601 studio range, 8.8 fixed point
+    inline Pixel yuv(int32_t y, int32_t u, int32_t v)
+    {
+        const int32_t c = 298 * (y - 16) + 128, d = u - 128, e = v - 128;
+        return RGB(clamp((c + 409*e) >> 8), clamp((c - 100*d - 208*e) >> 8), clamp((c + 516*d) >> 8));
+    }
+
+    inline byte luma(int32_t y)
+    {
+        return clamp((298 * (y - 16) + 128) >> 8);
+    }
+
+#ifdef __SSE2__
+    // Eight pixels from 16-bit Y, U and V lanes. Each product is paired with
+    // its multiplier so madd sums in 32 bits, which keeps this bit-exact with
+    // yuv().
+    inline void yuv8(__m128i y, __m128i u, __m128i v, Pixel *out)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i ky  = _mm_setr_epi16(298, 128, 298, 128, 298, 128, 298, 128);
+        const __m128i kr  = _mm_setr_epi16(0, 409, 0, 409, 0, 409, 0, 409);
+        const __m128i kg  = _mm_setr_epi16(-100, -208, -100, -208, -100, -208, -100, -208);
+        const __m128i kb  = _mm_setr_epi16(516, 0, 516, 0, 516, 0, 516, 0);
+
+        const __m128i c = _mm_sub_epi16(y, _mm_set1_epi16(16));
+        const __m128i d = _mm_sub_epi16(u, _mm_set1_epi16(128));
+        const __m128i e = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+        const __m128i cl = _mm_madd_epi16(_mm_unpacklo_epi16(c, one), ky);
+        const __m128i ch = _mm_madd_epi16(_mm_unpackhi_epi16(c, one), ky);
+        const __m128i dl = _mm_unpacklo_epi16(d, e), dh = _mm_unpackhi_epi16(d, e);
+
+#define CHANNEL(k) _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(cl, _mm_madd_epi16(dl, k)), 8), \
+                                   _mm_srai_epi32(_mm_add_epi32(ch, _mm_madd_epi16(dh, k)), 8))
+        const __m128i r = CHANNEL(kr), g = CHANNEL(kg), b = CHANNEL(kb);
+#undef CHANNEL
+
+        const __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+        const __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_set1_epi8(1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 0), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+
+    // luma() on eight 16-bit lanes
+    inline __m128i luma8(__m128i y)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i k   = _mm_setr_epi16(298, 128, 298, 128, 298, 128, 298, 128);
+        const __m128i c   = _mm_sub_epi16(y, _mm_set1_epi16(16));
+        return _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(c, one), k), 8),
+                               _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(c, one), k), 8));
+    }
+
+    // Spread 4:2:2 chroma (U0 V0 U1 V1 ...) out to one U and one V per pixel
+    inline __m128i spreadU(__m128i c)
+    {
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0));
+    }
+    inline __m128i spreadV(__m128i c)
+    {
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1));
+    }
+#endif
+
+    // YOFF is where the first Y sits in each 4-byte group: 0 for YUYV, 1 for UYVY
+    template <int YOFF>
+    void packed422_to_bgra(const byte *in, Pixel *out, uint32_t count)
+    {
+        const int UOFF = YOFF ? 0 : 1, VOFF = UOFF + 2;
+        uint32_t i = 0;
+#ifdef __SSE2__
+        const __m128i low = _mm_set1_epi16(0x00ff);
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i*2));
+            const __m128i y = YOFF ? _mm_srli_epi16(x, 8) : _mm_and_si128(x, low);
+            const __m128i c = YOFF ? _mm_and_si128(x, low) : _mm_srli_epi16(x, 8);
+            yuv8(y, spreadU(c), spreadV(c), out + i);
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            const byte *g = in + (i/2)*4;
+            out[i] = yuv(g[YOFF + (i & 1)*2], g[UOFF], g[VOFF]);
+        }
+    }
+
+    template <int YOFF>
+    void packed422_to_gray8(const byte *in, byte *out, uint32_t count)
+    {
+        uint32_t i = 0;
+#ifdef __SSE2__
+        const __m128i low = _mm_set1_epi16(0x00ff);
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i*2));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i*2 + 16));
+            const __m128i ya = YOFF ? _mm_srli_epi16(a, 8) : _mm_and_si128(a, low);
+            const __m128i yb = YOFF ? _mm_srli_epi16(b, 8) : _mm_and_si128(b, low);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(luma8(ya), luma8(yb)));
+        }
+#endif
+        for (; i < count; ++i)
+            out[i] = luma(in[(i/2)*4 + YOFF + (i & 1)*2]);
+    }
+}
+
+void i420_to_bgra(const byte *y, const byte *u, const byte *v, Pixel *out, uint32_t width, uint32_t height)
+{
+    const uint32_t cw = (width + 1) / 2;
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        const byte *yr = y + row*width, *ur = u + (row/2)*cw, *vr = v + (row/2)*cw;
+        Pixel *o = out + row*width;
+        uint32_t x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 8 <= width; x += 8)
+        {
+            int32_t u4, v4;
+            memcpy(&u4, ur + x/2, 4);
+            memcpy(&v4, vr + x/2, 4);
+            const __m128i uu = _mm_unpacklo_epi8(_mm_cvtsi32_si128(u4), zero);
+            const __m128i vv = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v4), zero);
+            yuv8(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(yr + x)), zero),
+                 _mm_unpacklo_epi16(uu, uu), _mm_unpacklo_epi16(vv, vv), o + x);
+        }
+#endif
+        for (; x < width; ++x)
+            o[x] = yuv(yr[x], ur[x/2], vr[x/2]);
+    }
+}
+
+void nv12_to_bgra(const byte *y, const byte *uv, Pixel *out, uint32_t width, uint32_t height)
+{
+    const uint32_t cw = (width + 1) / 2 * 2;
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        const byte *yr = y + row*width, *cr = uv + (row/2)*cw;
+        Pixel *o = out + row*width;
+        uint32_t x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cr + x)), zero);
+            yuv8(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(yr + x)), zero),
+                 spreadU(c), spreadV(c), o + x);
+        }
+#endif
+        for (; x < width; ++x)
+            o[x] = yuv(yr[x], cr[(x/2)*2], cr[(x/2)*2 + 1]);
+    }
+}
+
+void yuv444_to_bgra(const byte *y, const byte *u, const byte *v, Pixel *out, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8)
+        yuv8(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + i)), zero),
+             _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + i)), zero),
+             _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + i)), zero), out + i);
+#endif
+    for (; i < count; ++i)
+        out[i] = yuv(y[i], u[i], v[i]);
+}
+
+void yuyv_to_bgra(const byte *in, Pixel *out, uint32_t count)
+{
+    packed422_to_bgra<0>(in, out, count);
+}
+
+void uyvy_to_bgra(const byte *in, Pixel *out, uint32_t count)
+{
+    packed422_to_bgra<1>(in, out, count);
+}
+
+void bgra_to_gray8(const Pixel *in, byte *out, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    // Channels into 16-bit lanes; the weighted sum fits in 16 unsigned bits
+    const __m128i m = _mm_set1_epi32(0xff);
+    const __m128i kr = _mm_set1_epi16(77), kg = _mm_set1_epi16(150), kb = _mm_set1_epi16(29);
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i *p = reinterpret_cast<const __m128i*>(in + i);
+        __m128i y[2];
+        for (uint32_t h = 0; h < 2; ++h)
+        {
+            const __m128i p0 = _mm_loadu_si128(p + 2*h), p1 = _mm_loadu_si128(p + 2*h + 1);
+            const __m128i b = _mm_packs_epi32(_mm_and_si128(p0, m), _mm_and_si128(p1, m));
+            const __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), m), _mm_and_si128(_mm_srli_epi32(p1, 8), m));
+            const __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), m), _mm_and_si128(_mm_srli_epi32(p1, 16), m));
+            y[h] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, kr), _mm_mullo_epi16(g, kg)), _mm_mullo_epi16(b, kb)), 8);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(y[0], y[1]));
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = (77*R(in[i]) + 150*G(in[i]) + 29*B(in[i])) >> 8;
+}
+
+void bgra_to_i420(const Pixel *in, byte *y, byte *u, byte *v, uint32_t width, uint32_t height)
+{
+    const size_t count = size_t(width) * height;
+    size_t i = 0;
+#ifdef __SSE2__
+    // As bgra_to_gray8, with the studio-range weights; the sum still fits
+    // in 16 unsigned bits
+    const __m128i m = _mm_set1_epi32(0xff);
+    const __m128i kr = _mm_set1_epi16(66), kg = _mm_set1_epi16(129), kb = _mm_set1_epi16(25);
+    const __m128i round = _mm_set1_epi16(128), black = _mm_set1_epi16(16);
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i *p = reinterpret_cast<const __m128i*>(in + i);
+        __m128i l[2];
+        for (uint32_t h = 0; h < 2; ++h)
+        {
+            const __m128i p0 = _mm_loadu_si128(p + 2*h), p1 = _mm_loadu_si128(p + 2*h + 1);
+            const __m128i b = _mm_packs_epi32(_mm_and_si128(p0, m), _mm_and_si128(p1, m));
+            const __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), m), _mm_and_si128(_mm_srli_epi32(p1, 8), m));
+            const __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), m), _mm_and_si128(_mm_srli_epi32(p1, 16), m));
+            const __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, kr), _mm_mullo_epi16(g, kg)), _mm_add_epi16(_mm_mullo_epi16(b, kb), round));
+            l[h] = _mm_add_epi16(_mm_srli_epi16(sum, 8), black);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), _mm_packus_epi16(l[0], l[1]));
+    }
+#endif
+    for (; i < count; ++i)
+        y[i] = ((66*R(in[i]) + 129*G(in[i]) + 25*B(in[i]) + 128) >> 8) + 16;
+
+    const uint32_t cw = (width + 1) / 2, ch = (height + 1) / 2;
+    for (uint32_t cy = 0; cy < ch; ++cy)
+    {
+        const Pixel *r0 = in + size_t(2*cy) * width;
+        const Pixel *r1 = 2*cy + 1 < height ? r0 + width : r0;
+        for (uint32_t cx = 0; cx < cw; ++cx)
+        {
+            const uint32_t x0 = 2*cx, x1 = x0 + 1 < width ? x0 + 1 : x0;
+            const int32_t r = (R(r0[x0]) + R(r0[x1]) + R(r1[x0]) + R(r1[x1]) + 2) >> 2;
+            const int32_t g = (G(r0[x0]) + G(r0[x1]) + G(r1[x0]) + G(r1[x1]) + 2) >> 2;
+            const int32_t b = (B(r0[x0]) + B(r0[x1]) + B(r1[x0]) + B(r1[x1]) + 2) >> 2;
+            u[cy*cw + cx] = ((-38*r -  74*g + 112*b + 128) >> 8) + 128;
+            v[cy*cw + cx] = ((112*r -  94*g -  18*b + 128) >> 8) + 128;
+        }
+    }
+}
+
+void rgb24_to_gray8(const byte *in, byte *out, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i, in += 3)
+        out[i] = (77*in[0] + 150*in[1] + 29*in[2]) >> 8;
+}
+
+void luma_to_gray8(const byte *y, byte *out, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                _mm_packus_epi16(luma8(_mm_unpacklo_epi8(x, zero)), luma8(_mm_unpackhi_epi8(x, zero))));
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = luma(y[i]);
+}
+
+void yuyv_to_gray8(const byte *in, byte *out, uint32_t count)
+{
+    packed422_to_gray8<0>(in, out, count);
+}
+
+void uyvy_to_gray8(const byte *in, byte *out, uint32_t count)
+{
+    packed422_to_gray8<1>(in, out, count);
+}
+
+namespace
+{
+    template <int YOFF>
+    void packed422_to_planes(const byte *in, byte *y, byte *u, byte *v, uint32_t count)
+    {
+        uint32_t i = 0;
+#ifdef __SSE2__
+        const __m128i low = _mm_set1_epi16(0x00ff);
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i*2));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i*2 + 16));
+            const __m128i ya = YOFF ? _mm_srli_epi16(a, 8) : _mm_and_si128(a, low);
+            const __m128i yb = YOFF ? _mm_srli_epi16(b, 8) : _mm_and_si128(b, low);
+            const __m128i ca = YOFF ? _mm_and_si128(a, low) : _mm_srli_epi16(a, 8);
+            const __m128i cb = YOFF ? _mm_and_si128(b, low) : _mm_srli_epi16(b, 8);
+            // U,V pairs, then U and V apart
+            const __m128i c = _mm_packus_epi16(ca, cb);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), _mm_packus_epi16(ya, yb));
+            const __m128i cu = _mm_and_si128(c, low), cv = _mm_srli_epi16(c, 8);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(u + i/2), _mm_packus_epi16(cu, cu));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(v + i/2), _mm_packus_epi16(cv, cv));
+        }
+#endif
+        for (uint32_t j = i; j < count; ++j)
+            y[j] = in[(j/2)*4 + YOFF + (j & 1)*2];
+        for (uint32_t j = i/2; j < (count + 1) / 2; ++j)
+        {
+            u[j] = in[j*4 + 1 - YOFF];
+            v[j] = in[j*4 + 3 - YOFF];
+        }
+    }
+}
+
+void yuyv_to_planes(const byte *in, byte *y, byte *u, byte *v, uint32_t count)
+{
+    packed422_to_planes<0>(in, y, u, v, count);
+}
+
+void uyvy_to_planes(const byte *in, byte *y, byte *u, byte *v, uint32_t count)
+{
+    packed422_to_planes<1>(in, y, u, v, count);
+}
+
+void split_uv(const byte *uv, byte *u, byte *v, size_t count)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + i*2));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + i*2 + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u + i), _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        u[i] = uv[i*2];
+        v[i] = uv[i*2 + 1];
+    }
+}
+
+void gray16_to_bgra(const uint16_t *in, Pixel *out, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+        out[i] = RGB(in[i] >> 8, in[i] >> 8, in[i] >> 8);
+}
+
+void gray16_to_gray8(const uint16_t *in, byte *out, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i *p = reinterpret_cast<const __m128i*>(in + i);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                _mm_packus_epi16(_mm_srli_epi16(_mm_loadu_si128(p), 8), _mm_srli_epi16(_mm_loadu_si128(p + 1), 8)));
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = in[i] >> 8;
+}
+
+void gray8_to_gray16(const byte *in, uint16_t *out, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i *o = reinterpret_cast<__m128i*>(out + i);
+        _mm_storeu_si128(o + 0, _mm_unpacklo_epi8(g, g));
+        _mm_storeu_si128(o + 1, _mm_unpackhi_epi8(g, g));
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = in[i] * 257;
+}
+
+void bgra_to_gray16(const Pixel *in, uint16_t *out, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+        out[i] = 77*R(in[i]) + 150*G(in[i]) + 29*B(in[i]);
+}
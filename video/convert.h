@@ -0,0 +1,162 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include "../global.h"
+
+// Pixel format conversions. The SIMD versions are picked at runtime, so these
+// are safe to call anywhere.
+
+/**
+ * Packed 24-bit RGB (as in a PPM) to BGRA
+ * @param in    count*3 bytes
+ * @param out   count pixels
+ * @param count number of pixels
+ */
+void rgb24_to_bgra(const byte *in, Pixel *out, uint32_t count);
+
+/**
+ * BGRA to packed 24-bit RGB (as in a PPM or PNG), dropping alpha
+ * @param in    count pixels
+ * @param out   count*3 bytes
+ * @param count number of pixels
+ */
+void bgra_to_rgb24(const Pixel *in, byte *out, uint32_t count);
+
+/**
+ * 8-bit gray (as in a PGM) to BGRA
+ * @param in    count bytes
+ * @param out   count pixels
+ * @param count number of pixels
+ */
+void gray8_to_bgra(const byte *in, Pixel *out, uint32_t count);
+
+/**
+ * Planar 4:2:0 YUV (BT.601, studio range) to BGRA. Chroma planes are
+ * (width+1)/2 by (height+1)/2.
+ * @param y     width*height luma samples
+ * @param u     Cb plane
+ * @param v     Cr plane
+ * @param out   width*height pixels
+ */
+void i420_to_bgra(const byte *y, const byte *u, const byte *v, Pixel *out, uint32_t width, uint32_t height);
+
+/**
+ * 4:2:0 YUV with interleaved chroma (NV12) to BGRA
+ * @param y     width*height luma samples
+ * @param uv    (height+1)/2 rows of (width+1)/2 U,V pairs
+ * @param out   width*height pixels
+ */
+void nv12_to_bgra(const byte *y, const byte *uv, Pixel *out, uint32_t width, uint32_t height);
+
+/**
+ * Planar YUV with a chroma sample for every pixel (4:4:4) to BGRA
+ * @param y     count luma samples
+ * @param u     count Cb samples
+ * @param v     count Cr samples
+ * @param out   count pixels
+ * @param count number of pixels
+ */
+void yuv444_to_bgra(const byte *y, const byte *u, const byte *v, Pixel *out, uint32_t count);
+
+/**
+ * One row of packed 4:2:2 YUV to BGRA. With an odd count, the last pixel
+ * still has a whole Y,U,Y,V group (only the first Y is used).
+ * @param in    (count+1)/2*4 bytes, as Y0 U Y1 V (yuyv) or U Y0 V Y1 (uyvy)
+ * @param out   count pixels
+ * @param count number of pixels
+ */
+void yuyv_to_bgra(const byte *in, Pixel *out, uint32_t count);
+void uyvy_to_bgra(const byte *in, Pixel *out, uint32_t count);
+
+/**
+ * BGRA to 8-bit gray, weighted like Vb()
+ * @param in    count pixels
+ * @param out   count bytes
+ * @param count number of pixels
+ */
+void bgra_to_gray8(const Pixel *in, byte *out, uint32_t count);
+
+/**
+ * BGRA to planar 4:2:0 YUV (BT.601, studio range), the reverse of
+ * i420_to_bgra. Each chroma sample is from the mean of its 2x2 block, with
+ * the last row and column repeated when the size is odd.
+ * @param in    width*height pixels
+ * @param y     width*height luma samples
+ * @param u     (width+1)/2 by (height+1)/2 Cb plane
+ * @param v     Cr plane, the same size
+ */
+void bgra_to_i420(const Pixel *in, byte *y, byte *u, byte *v, uint32_t width, uint32_t height);
+
+/**
+ * Packed 24-bit RGB to 8-bit gray, weighted like Vb()
+ * @param in    count*3 bytes
+ * @param out   count bytes
+ * @param count number of pixels
+ */
+void rgb24_to_gray8(const byte *in, byte *out, uint32_t count);
+
+/**
+ * Studio range luma (16-235) to full range gray, ie the gray a YUV to BGRA
+ * conversion would give for a colourless pixel
+ * @param y     count luma samples
+ * @param out   count bytes
+ * @param count number of pixels
+ */
+void luma_to_gray8(const byte *y, byte *out, uint32_t count);
+
+/**
+ * One row of packed 4:2:2 YUV to full range gray
+ * @param in    (count+1)/2*4 bytes
+ * @param out   count bytes
+ * @param count number of pixels
+ */
+void yuyv_to_gray8(const byte *in, byte *out, uint32_t count);
+void uyvy_to_gray8(const byte *in, byte *out, uint32_t count);
+
+/**
+ * One row of packed 4:2:2 YUV split into planes, left in studio range
+ * @param in    (count+1)/2*4 bytes, as Y0 U Y1 V (yuyv) or U Y0 V Y1 (uyvy)
+ * @param y     count luma samples
+ * @param u     (count+1)/2 Cb samples
+ * @param v     (count+1)/2 Cr samples
+ * @param count number of pixels
+ */
+void yuyv_to_planes(const byte *in, byte *y, byte *u, byte *v, uint32_t count);
+void uyvy_to_planes(const byte *in, byte *y, byte *u, byte *v, uint32_t count);
+
+/**
+ * Interleaved chroma (as in NV12) to separate Cb and Cr planes
+ * @param uv    count U,V pairs
+ * @param u     count Cb samples
+ * @param v     count Cr samples
+ * @param count number of pairs
+ */
+void split_uv(const byte *uv, byte *u, byte *v, size_t count);
+
+/**
+ * 16-bit gray to BGRA or 8-bit gray, keeping the high byte
+ * @param in    count samples
+ * @param out   count pixels or bytes
+ * @param count number of pixels
+ */
+void gray16_to_bgra(const uint16_t *in, Pixel *out, uint32_t count);
+void gray16_to_gray8(const uint16_t *in, byte *out, uint32_t count);
+
+/**
+ * 8-bit gray to 16-bit, so that 255 becomes 65535
+ * @param in    count bytes
+ * @param out   count samples
+ * @param count number of pixels
+ */
+void gray8_to_gray16(const byte *in, uint16_t *out, uint32_t count);
+
+/**
+ * BGRA to 16-bit gray, with the weights of bgra_to_gray8 but without
+ * dropping the fraction
+ * @param in    count pixels
+ * @param out   count samples
+ * @param count number of pixels
+ */
+void bgra_to_gray16(const Pixel *in, uint16_t *out, uint32_t count);
+
+#endif
@@ -0,0 +1,165 @@
+#include <cstring>
+
+#include "../global.h"
+#include "format.h"
+#include "convert.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    const FormatInfo formats[FORMAT_COUNT] = {
+        {"bgra32", 32, false},
+        {"rgb24",  24, false},
+        {"yuyv",   16, false},
+        {"uyvy",   16, false},
+        {"nv12",   12, true},
+        {"i420",   12, true},
+        {"gray8",   8, false},
+        {"gray16", 16, false},
+    };
+}
+
+const FormatInfo& formatInfo(PixelFormat f)
+{
+    return formats[f];
+}
+
+PixelFormat formatByName(const string &name)
+{
+    for (uint32_t i = 0; i < FORMAT_COUNT; ++i)
+        if (name == formats[i].name)
+            return PixelFormat(i);
+    throw ArgumentError("Unknown pixel format " + name);
+}
+
+size_t frameBytes(PixelFormat f, uint32_t width, uint32_t height)
+{
+    const size_t luma = size_t(width) * height, pairs = (width + 1) / 2;
+    switch (f)
+    {
+        case FORMAT_BGRA32: return luma * 4;
+        case FORMAT_RGB24:  return luma * 3;
+        case FORMAT_YUYV:
+        case FORMAT_UYVY:   return pairs * 4 * height;
+        case FORMAT_NV12:
+        case FORMAT_I420:   return luma + 2 * pairs * ((height + 1) / 2);
+        case FORMAT_GRAY8:  return luma;
+        case FORMAT_GRAY16: return luma * 2;
+        default:            break;
+    }
+    throw ArgumentError("Bad pixel format " + stringify(f));
+}
+
+bool canConvert(PixelFormat from, PixelFormat to)
+{
+    if (from == to || to == FORMAT_BGRA32 || to == FORMAT_GRAY8)
+        return true;
+    if (to == FORMAT_RGB24 || to == FORMAT_I420)
+        return from == FORMAT_BGRA32;
+    return to == FORMAT_GRAY16 && (from == FORMAT_BGRA32 || from == FORMAT_GRAY8);
+}
+
+void convertFrame(PixelFormat from, const byte *in, PixelFormat to, byte *out, uint32_t width, uint32_t height)
+{
+    if (from == to)
+    {
+        memcpy(out, in, frameBytes(from, width, height));
+        return;
+    }
+
+    const size_t luma = size_t(width) * height, chroma = size_t((width + 1) / 2) * ((height + 1) / 2);
+    // Bytes per row of packed 4:2:2
+    const size_t row = size_t((width + 1) / 2) * 4;
+
+    if (to == FORMAT_BGRA32)
+    {
+        Pixel *o = reinterpret_cast<Pixel*>(out);
+        switch (from)
+        {
+            case FORMAT_RGB24:
+                rgb24_to_bgra(in, o, luma);
+                return;
+            case FORMAT_YUYV:
+                for (uint32_t y = 0; y < height; ++y)
+                    yuyv_to_bgra(in + y*row, o + y*width, width);
+                return;
+            case FORMAT_UYVY:
+                for (uint32_t y = 0; y < height; ++y)
+                    uyvy_to_bgra(in + y*row, o + y*width, width);
+                return;
+            case FORMAT_NV12:
+                nv12_to_bgra(in, in + luma, o, width, height);
+                return;
+            case FORMAT_I420:
+                i420_to_bgra(in, in + luma, in + luma + chroma, o, width, height);
+                return;
+            case FORMAT_GRAY8:
+                gray8_to_bgra(in, o, luma);
+                return;
+            case FORMAT_GRAY16:
+                gray16_to_bgra(reinterpret_cast<const uint16_t*>(in), o, luma);
+                return;
+            default:
+                break;
+        }
+    }
+    else if (to == FORMAT_GRAY8)
+    {
+        switch (from)
+        {
+            case FORMAT_BGRA32:
+                bgra_to_gray8(reinterpret_cast<const Pixel*>(in), out, luma);
+                return;
+            case FORMAT_RGB24:
+                rgb24_to_gray8(in, out, luma);
+                return;
+            case FORMAT_YUYV:
+                for (uint32_t y = 0; y < height; ++y)
+                    yuyv_to_gray8(in + y*row, out + y*width, width);
+                return;
+            case FORMAT_UYVY:
+                for (uint32_t y = 0; y < height; ++y)
+                    uyvy_to_gray8(in + y*row, out + y*width, width);
+                return;
+            case FORMAT_NV12:
+            case FORMAT_I420:
+                // The luma plane is all there is to it
+                luma_to_gray8(in, out, luma);
+                return;
+            case FORMAT_GRAY16:
+                gray16_to_gray8(reinterpret_cast<const uint16_t*>(in), out, luma);
+                return;
+            default:
+                break;
+        }
+    }
+    else if (to == FORMAT_RGB24 && from == FORMAT_BGRA32)
+    {
+        bgra_to_rgb24(reinterpret_cast<const Pixel*>(in), out, luma);
+        return;
+    }
+    else if (to == FORMAT_I420 && from == FORMAT_BGRA32)
+    {
+        bgra_to_i420(reinterpret_cast<const Pixel*>(in), out, out + luma, out + luma + chroma, width, height);
+        return;
+    }
+    else if (to == FORMAT_GRAY16)
+    {
+        uint16_t *o = reinterpret_cast<uint16_t*>(out);
+        switch (from)
+        {
+            case FORMAT_BGRA32:
+                bgra_to_gray16(reinterpret_cast<const Pixel*>(in), o, luma);
+                return;
+            case FORMAT_GRAY8:
+                gray8_to_gray16(in, o, luma);
+                return;
+            default:
+                break;
+        }
+    }
+
+    throw UnimplementedError(string("converting ") + formatInfo(from).name + " to " + formatInfo(to).name + " " + FUNCTION_HERE);
+}
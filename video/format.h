@@ -0,0 +1,65 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <string>
+#include "../global.h"
+
+// How a frame's pixels are laid out in memory
+enum PixelFormat
+{
+    FORMAT_BGRA32,  // Pixel, what the filters work on
+    FORMAT_RGB24,   // packed R,G,B bytes (as in a PPM)
+    FORMAT_YUYV,    // packed 4:2:2, Y0 U Y1 V
+    FORMAT_UYVY,    // packed 4:2:2, U Y0 V Y1
+    FORMAT_NV12,    // 4:2:0, Y plane then an interleaved U,V plane
+    FORMAT_I420,    // 4:2:0, Y plane then U plane then V plane
+    FORMAT_GRAY8,   // one byte of luma (full range)
+    FORMAT_GRAY16,  // native-endian 16-bit gray, for results too fine for 8
+    FORMAT_COUNT
+};
+
+struct FormatInfo
+{
+    // Name used on the command line and in messages
+    const char *name;
+    // Bits per pixel, averaged over the frame for subsampled formats
+    uint16_t depth;
+    // Luma and chroma are stored apart (Y first)
+    bool planar;
+};
+
+/** Describe a format */
+const FormatInfo& formatInfo(PixelFormat f);
+
+/**
+ * Look a format up by name (bgra32, rgb24, yuyv, uyvy, nv12, i420, gray8, gray16)
+ * @throw ArgumentError if there's no such format
+ */
+PixelFormat formatByName(const std::string &name);
+
+/**
+ * How many bytes a frame takes. Chroma is rounded up for odd sizes.
+ */
+size_t frameBytes(PixelFormat f, uint32_t width, uint32_t height);
+
+/**
+ * Whether convertFrame can do from to to. Anything converts to BGRA32 and
+ * GRAY8, BGRA32 and the grays convert to GRAY16, BGRA32 converts to RGB24
+ * and I420, and a format converts to itself.
+ */
+bool canConvert(PixelFormat from, PixelFormat to);
+
+/**
+ * Convert a whole frame. YUV is taken as BT.601, studio range. Packed
+ * formats are converted row by row, so a band of rows can be converted
+ * by passing its first row and its height (but not to I420, which
+ * mixes pairs of rows).
+ * @param from  Format of in
+ * @param in    frameBytes(from, width, height) bytes
+ * @param to    Format of out
+ * @param out   frameBytes(to, width, height) bytes
+ * @throw UnimplementedError unless canConvert(from, to)
+ */
+void convertFrame(PixelFormat from, const byte *in, PixelFormat to, byte *out, uint32_t width, uint32_t height);
+
+#endif
@@ -0,0 +1,221 @@
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../global.h"
+#include "framering.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    size_t page_up(size_t x)
+    {
+        const size_t page = sysconf(_SC_PAGESIZE);
+        return (x + page - 1) & ~(page - 1);
+    }
+
+    // Waits while *word is still value. Shared (not FUTEX_PRIVATE), so it
+    // works across processes, and fine on a read-only mapping.
+    void futex_wait(const uint32_t *word, uint32_t value, int32_t timeout)
+    {
+        struct timespec t;
+        t.tv_sec  = timeout / 1000;
+        t.tv_nsec = (timeout % 1000) * 1000000L;
+        syscall(SYS_futex, word, FUTEX_WAIT, value, timeout < 0 ? NULL : &t, NULL, 0);
+    }
+
+    void futex_wake(uint32_t *word)
+    {
+        syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+FrameRingWriter::FrameRingWriter(const string &name, uint32_t width, uint32_t height, PixelFormat format, uint32_t slots)
+    : name(name), length(0), header(NULL), slots(NULL), map(NULL)
+{
+    Context c("While creating the shared frame ring " + name);
+    if (slots < 2)
+        throw ArgumentError("A frame ring needs at least two slots");
+
+    const size_t frame_bytes = frameBytes(format, width, height);
+    const size_t data = page_up(sizeof(FrameRingHeader) + slots * sizeof(FrameRingSlot));
+    const size_t stride = page_up(frame_bytes);
+    length = data + stride * slots;
+
+    // Anything left by a writer that died goes, so readers can't attach to it
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT|O_EXCL|O_RDWR, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+    if (fd < 0)
+        throw FrameRingError("Could not create " + name + " (" + strerror(errno) + ")");
+    if (ftruncate(fd, length) != 0)
+    {
+        const int e = errno;
+        close(fd);
+        shm_unlink(name.c_str());
+        throw FrameRingError("Could not size " + name + " (" + strerror(e) + ")");
+    }
+    void *m = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    const int e = errno;
+    close(fd);
+    if (m == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        throw FrameRingError("Could not map " + name + " (" + strerror(e) + ")");
+    }
+
+    map = static_cast<byte*>(m);
+    header = reinterpret_cast<FrameRingHeader*>(map);
+    this->slots = reinterpret_cast<FrameRingSlot*>(map + sizeof(FrameRingHeader));
+
+    // A new mapping is zeroed, so only the description needs filling in.
+    // The magic goes last, so nobody attaches to half a header.
+    header->width       = width;
+    header->height      = height;
+    header->format      = format;
+    header->slots       = slots;
+    header->frame_bytes = frame_bytes;
+    header->stride      = stride;
+    header->data        = data;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, FRAMERING_MAGIC, sizeof(header->magic));
+}
+
+FrameRingWriter::~FrameRingWriter(void)
+{
+    // Readers keep their mappings; they just never see another frame
+    munmap(map, length);
+    shm_unlink(name.c_str());
+}
+
+void FrameRingWriter::write(const byte *pixels, size_t pitch, uint64_t time)
+{
+    const uint64_t n = header->latest + 1;
+    const uint32_t i = n % header->slots;
+    FrameRingSlot &s = slots[i];
+    byte *out = map + header->data + i * header->stride;
+
+    // Anyone still reading this buffer sees the lock move, and knows
+    const uint32_t lock = s.lock + 1;
+    __atomic_store_n(&s.lock, lock, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    const size_t row = frameBytes(PixelFormat(header->format), header->width, 1);
+    if (pitch == row || formatInfo(PixelFormat(header->format)).planar)
+        memcpy(out, pixels, header->frame_bytes);
+    else
+        for (uint32_t y = 0; y < header->height; ++y)
+            memcpy(out + y * row, pixels + y * pitch, row);
+    s.frame = n;
+    s.time  = time;
+
+    __atomic_store_n(&s.lock, lock + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->latest, n, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&header->futex, 1, __ATOMIC_RELEASE);
+    futex_wake(&header->futex);
+}
+
+FrameRingReader::FrameRingReader(const string &name)
+    : name(name), length(0), header(NULL), slots(NULL), map(NULL),
+      frame(0), time(0), held(NULL), held_lock(0), taken(0), skipped(0), torn(0)
+{
+    Context c("While attaching to the shared frame ring " + name);
+
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        throw FrameRingError("Could not open " + name + " (" + strerror(errno) + ")");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FrameRingHeader))
+    {
+        close(fd);
+        throw FrameRingError(name + " isn't a frame ring (or isn't ready yet)");
+    }
+    length = st.st_size;
+    void *m = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    const int e = errno;
+    close(fd);
+    if (m == MAP_FAILED)
+        throw FrameRingError("Could not map " + name + " (" + strerror(e) + ")");
+
+    map = static_cast<const byte*>(m);
+    header = reinterpret_cast<const FrameRingHeader*>(map);
+    slots = reinterpret_cast<const FrameRingSlot*>(map + sizeof(FrameRingHeader));
+
+    if (memcmp(header->magic, FRAMERING_MAGIC, sizeof(header->magic)) != 0)
+    {
+        munmap(const_cast<byte*>(map), length);
+        throw FrameRingError(name + " isn't a frame ring (or isn't ready yet)");
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (header->format >= FORMAT_COUNT || header->slots < 2 ||
+        header->frame_bytes != frameBytes(PixelFormat(header->format), header->width, header->height) ||
+        header->stride < header->frame_bytes || header->data + header->stride * header->slots > length)
+    {
+        munmap(const_cast<byte*>(map), length);
+        throw FrameRingError(name + " has a bad header");
+    }
+}
+
+FrameRingReader::~FrameRingReader(void)
+{
+    munmap(const_cast<byte*>(map), length);
+}
+
+const byte* FrameRingReader::acquire(int32_t timeout)
+{
+    for (;;)
+    {
+        // Read the futex word first: if a frame comes after that, the wait
+        // below returns straight away instead of missing it
+        const uint32_t word = __atomic_load_n(&header->futex, __ATOMIC_ACQUIRE);
+        const uint64_t n = __atomic_load_n(&header->latest, __ATOMIC_ACQUIRE);
+        if (n > frame)
+        {
+            const uint32_t i = n % header->slots;
+            const FrameRingSlot &s = slots[i];
+            const uint32_t lock = __atomic_load_n(&s.lock, __ATOMIC_ACQUIRE);
+            // The writer is already back here, so there's a newer one
+            if ((lock & 1) || s.frame != n)
+                continue;
+
+            if (frame)
+                skipped += n - frame - 1;
+            ++taken;
+            frame = n;
+            time  = s.time;
+            held  = &s;
+            held_lock = lock;
+            return map + header->data + i * header->stride;
+        }
+
+        if (timeout == 0)
+            return NULL;
+        futex_wait(&header->futex, word, timeout);
+        // One wait is all a timeout gets. A wake that brought nothing new
+        // (or a timeout) ends up here again with no frame.
+        if (timeout > 0 && __atomic_load_n(&header->latest, __ATOMIC_ACQUIRE) <= frame)
+            return NULL;
+    }
+}
+
+bool FrameRingReader::release(void)
+{
+    if (!held)
+        return true;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const bool intact = __atomic_load_n(&held->lock, __ATOMIC_RELAXED) == held_lock;
+    if (!intact)
+        ++torn;
+    held = NULL;
+    return intact;
+}
@@ -0,0 +1,159 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <string>
+#include <stdint.h>
+
+#include "../global.h"
+#include "videodevice.h"
+
+// A ring of frames in POSIX shared memory (/dev/shm/<name>), written by one
+// process and read, in place, by any number of others on the same host.
+//
+// The writer fills the buffers in turn. Each buffer has a sequence lock: it's
+// odd while the writer is in the buffer and even otherwise, so a reader can
+// tell afterwards whether a frame it used in place was written over (the
+// writer never waits for readers, so one that falls slots-1 frames behind
+// gets lapped). The header's futex word changes with every frame, so readers
+// can sleep until there's a new one.
+//
+// Layout: FrameRingHeader, FrameRingSlot * slots, then the buffers, each
+// starting on a page boundary.
+
+#define FRAMERING_MAGIC "GLASRING"
+
+struct FrameRingSlot
+{
+    // Odd while being written
+    uint32_t lock;
+    uint32_t pad;
+    // The frame in the buffer (from 1), and when it was captured
+    // (CLOCK_MONOTONIC nanoseconds)
+    uint64_t frame;
+    uint64_t time;
+    byte reserved[40];
+};
+
+struct FrameRingHeader
+{
+    char magic[8];
+    uint32_t width, height;
+    // PixelFormat of every frame, and how many bytes one takes
+    uint32_t format;
+    uint32_t slots;
+    uint64_t frame_bytes;
+    // Bytes from the start of one buffer to the next, and to the first
+    uint64_t stride;
+    uint64_t data;
+    byte reserved[16];
+
+    // The last frame published (0 before the first), on a line of its own
+    uint64_t latest;
+    // Bumped after every frame, for readers to wait on
+    uint32_t futex;
+    byte reserved2[52];
+};
+
+// The writing side. Creates the ring (replacing any old one of that name)
+// and removes it again when done.
+class FrameRingWriter
+{
+    public:
+        /**
+         * @param name      shared memory name, like /glasses-3
+         * @param width     size of every frame
+         * @param height
+         * @param format    PixelFormat of every frame
+         * @param slots     how many frames the ring holds. Readers get
+         *                  slots-1 frames' time to finish with one.
+         */
+        FrameRingWriter(const std::string &name, uint32_t width, uint32_t height, PixelFormat format, uint32_t slots = 4);
+        ~FrameRingWriter(void);
+
+        /**
+         * Publish a frame
+         * @param pixels    height rows of the frame
+         * @param pitch     bytes from the start of one row to the next
+         * @param time      when the frame was captured (monotonic_ns), so
+         *                  readers can tell how old it is
+         */
+        void write(const byte *pixels, size_t pitch, uint64_t time);
+
+        inline const std::string& getName(void) const {return name;};
+        inline PixelFormat getFormat(void) const {return PixelFormat(header->format);};
+        inline uint64_t getFrames(void) const {return header->latest;};
+
+    private:
+        const std::string name;
+        size_t length;
+        FrameRingHeader *header;
+        FrameRingSlot *slots;
+        byte *map;
+
+        explicit FrameRingWriter(const FrameRingWriter&);
+        FrameRingWriter& operator=(const FrameRingWriter&);
+};
+
+// The reading side. Maps a ring read-only and lends out its frames in place.
+class FrameRingReader
+{
+    public:
+        /**
+         * @param name  shared memory name the writer used
+         * @throw FrameRingError if there's no such ring
+         */
+        explicit FrameRingReader(const std::string &name);
+        ~FrameRingReader(void);
+
+        /**
+         * Take the newest frame, skipping any published since the last one
+         * taken. Use it in place, and then call release.
+         * @param timeout   milliseconds to wait for a new frame. Negative
+         *                  waits forever; 0 doesn't wait.
+         * @return          the frame, or NULL if none came in time
+         */
+        const byte* acquire(int32_t timeout = -1);
+
+        /**
+         * Finish with the frame from acquire
+         * @return  false if the writer got to it while it was in use, in
+         *          which case whatever was made of it is suspect
+         */
+        bool release(void);
+
+        inline uint32_t getWidth(void)  const {return header->width;};
+        inline uint32_t getHeight(void) const {return header->height;};
+        inline PixelFormat getFormat(void) const {return PixelFormat(header->format);};
+        // The frame number and capture time of the last frame acquired
+        inline uint64_t getFrame(void) const {return frame;};
+        inline uint64_t getTime(void) const {return time;};
+        // Frames taken, skipped over to catch up, and written over in use
+        inline uint64_t getTaken(void)   const {return taken;};
+        inline uint64_t getSkipped(void) const {return skipped;};
+        inline uint64_t getTorn(void)    const {return torn;};
+
+    private:
+        const std::string name;
+        size_t length;
+        const FrameRingHeader *header;
+        const FrameRingSlot *slots;
+        const byte *map;
+
+        // The frame held, and its slot's lock when it was taken
+        uint64_t frame, time;
+        const FrameRingSlot *held;
+        uint32_t held_lock;
+        uint64_t taken, skipped, torn;
+
+        explicit FrameRingReader(const FrameRingReader&);
+        FrameRingReader& operator=(const FrameRingReader&);
+};
+
+class FrameRingError : public VideoError
+{
+    public:
+        FrameRingError(const std::string& our_message) throw ():
+            VideoError(our_message) {};
+};
+
+#endif
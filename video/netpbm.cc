@@ -0,0 +1,148 @@
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "netpbm.h"
+#include "convert.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    inline bool is_space(byte c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+}
+
+Netpbm::Netpbm(const char *file) : path(file), map(MAP_FAILED), length(0)
+{
+    Context c(string("When loading netpbm image ") + file);
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        throw NetpbmError(string("Could not open file ") + file + " (" + strerror(errno) + ")");
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        throw NetpbmError(string("Could not stat file ") + file + " (" + strerror(errno) + ")");
+    }
+    length = st.st_size;
+    if (length > 0)
+        map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        throw NetpbmError(string("Could not map file ") + file + " (" + strerror(errno) + ")");
+
+    try {
+        const byte *p = static_cast<const byte*>(map), *end = p + length;
+
+        if (length < 2 || p[0] != 'P' || (p[1] != '6' && p[1] != '5'))
+            throw NetpbmError(path + " isn't a binary PPM (P6) or PGM (P5)");
+        channels = p[1] == '6' ? 3 : 1;
+        p += 2;
+
+        width  = number(p, end, "width");
+        height = number(p, end, "height");
+        maxval = number(p, end, "maxval");
+        if (width == 0 || height == 0)
+            throw NetpbmError(path + " has no pixels");
+        if (maxval == 0 || maxval > 65535)
+            throw NetpbmError(path + " has an illegal maxval (" + stringify(maxval) + ")");
+
+        // Exactly one whitespace character separates the header from the samples
+        if (p == end || !is_space(*p))
+            throw NetpbmError(path + ": expected whitespace after the header");
+        raster = ++p;
+
+        // The header is untrusted: none of these products may wrap, and the
+        // decoded image has to be allocatable as well as the samples present
+        const size_t limit = numeric_limits<size_t>::max();
+        const size_t sample = channels * (maxval > 255 ? 2 : 1);
+        if (height > limit / width || size_t(width) * height > limit / max(sample, sizeof(Pixel)))
+            throw NetpbmError(path + " is too big (" + stringify(width) + "x" + stringify(height) + ")");
+        const size_t need = size_t(width) * height * sample;
+        if (size_t(end - raster) < need)
+            throw NetpbmError(path + " is truncated (the header doesn't agree with the data)");
+
+        // It's about to be read front to back, once
+        madvise(map, length, MADV_SEQUENTIAL);
+    } catch (...) {
+        munmap(map, length);
+        throw;
+    }
+}
+
+Netpbm::~Netpbm()
+{
+    munmap(map, length);
+}
+
+uint32_t Netpbm::number(const byte *&p, const byte *end, const char *what) const
+{
+    for (;;)
+    {
+        while (p != end && is_space(*p))
+            ++p;
+        if (p == end || *p != '#')
+            break;
+        while (p != end && *p != '\n' && *p != '\r')
+            ++p;
+    }
+
+    if (p == end || *p < '0' || *p > '9')
+        throw NetpbmError(path + ": expected the " + what + " in the header");
+
+    uint64_t n = 0;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p)
+    {
+        n = n*10 + (*p - '0');
+        if (n > 0xffffffffULL)
+            throw NetpbmError(path + ": the " + what + " is too big");
+    }
+    return n;
+}
+
+void Netpbm::toBGRA(Pixel *out) const
+{
+    const size_t count = size_t(width) * height;
+
+    if (maxval == 255)
+    {
+        // A row at a time: the converters count in uint32, the image needn't
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const size_t i = size_t(y) * width;
+            if (channels == 3)
+                rgb24_to_bgra(raster + i*3, out + i, width);
+            else
+                gray8_to_bgra(raster + i, out + i, width);
+        }
+        return;
+    }
+
+    // Odd maxvals are rare enough not to bother being fast about. Samples are
+    // big-endian when they need two bytes.
+    const uint32_t size = maxval > 255 ? 2 : 1;
+    byte v[3];
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+            const byte *s = raster + (i*channels + c)*size;
+            uint32_t sample = size == 2 ? (s[0] << 8 | s[1]) : s[0];
+            v[c] = (min(sample, maxval) * 255 + maxval/2) / maxval;
+        }
+        out[i] = channels == 3 ? RGB(v[0], v[1], v[2]) : RGB(v[0], v[0], v[0]);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef NETPBM_H
+#define NETPBM_H
+
+#include <string>
+#include <sys/types.h>
+
+#include "../global.h"
+#include "videodevice.h"
+
+// A binary PPM (P6) or PGM (P5), mapped into memory. The whole header grammar
+// is understood: comments, any whitespace, and any maxval up to 65535.
+class Netpbm
+{
+    public:
+        /**
+         * Map and parse an image
+         * @param path  Path to the file
+         */
+        explicit Netpbm(const char *path);
+        ~Netpbm();
+
+        inline uint32_t getWidth(void)    const {return width;};
+        inline uint32_t getHeight(void)   const {return height;};
+        inline uint32_t getMaxval(void)   const {return maxval;};
+        // 3 for a PPM, 1 for a PGM
+        inline uint32_t getChannels(void) const {return channels;};
+
+        /**
+         * Convert the image to BGRA
+         * @param out   width*height pixels
+         */
+        void toBGRA(Pixel *out) const;
+
+    private:
+        /** Read a header number, skipping whitespace and comments before it */
+        uint32_t number(const byte *&p, const byte *end, const char *what) const;
+
+        const std::string path;
+        void *map;
+        size_t length;
+        uint32_t width, height, maxval, channels;
+        // Start of the samples
+        const byte *raster;
+
+        explicit Netpbm(const Netpbm&);
+        Netpbm& operator=(const Netpbm&);
+};
+
+class NetpbmError : public VideoError
+{
+    public:
+        NetpbmError(const std::string& our_message) throw ():
+            VideoError(our_message) {};
+};
+
+#endif
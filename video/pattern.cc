@@ -0,0 +1,283 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../global.h"
+#include "pattern.h"
+#include "convert.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    const char prefix[] = "pattern:";
+
+    // 75% bars, in the usual order
+    const Pixel bars[8] = {
+        RGB(191, 191, 191), RGB(191, 191,   0), RGB(  0, 191, 191), RGB(  0, 191,   0),
+        RGB(191,   0, 191), RGB(191,   0,   0), RGB(  0,   0, 191), RGB(  0,   0,   0)
+    };
+
+    const Pixel background = RGB(32, 32, 48);
+}
+
+bool Pattern::handles(const string &name)
+{
+    return name.compare(0, sizeof(prefix) - 1, prefix) == 0;
+}
+
+Pattern::Pattern(const string &name, double fps)
+    : pace(fps), pitch(0), offset(0), count(0), seed(2463534242U), changed(true)
+{
+    Context c("While creating pattern " + name);
+    const string which = handles(name) ? name.substr(sizeof(prefix) - 1) : name;
+    if (which == "bars")
+        kind = PATTERN_BARS;
+    else if (which == "gradient")
+        kind = PATTERN_GRADIENT;
+    else if (which == "noise")
+        kind = PATTERN_NOISE;
+    else if (which == "shapes")
+        kind = PATTERN_SHAPES;
+    else
+        throw PatternError("No pattern called " + which + " (try bars, gradient, noise or shapes)");
+
+    width  = 640;
+    height = 480;
+    depth  = 32;
+    format = FORMAT_BGRA32;
+    generate();
+}
+
+void Pattern::setParams(uint32_t width, uint32_t height, PixelFormat format)
+{
+    Context c("While setting Pattern params (" + stringify(width) + "," + stringify(height) + " " + formatInfo(format).name + ")");
+    if (width == 0 || height == 0)
+        throw PatternError("Patterns need a size");
+    this->width  = width;
+    this->height = height;
+    this->format = format == FORMAT_GRAY8 ? FORMAT_GRAY8 : FORMAT_BGRA32;
+    this->depth  = formatInfo(this->format).depth;
+    generate();
+}
+
+uint32_t Pattern::random(void)
+{
+    // xorshift32
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+void Pattern::generate(void)
+{
+    const uint32_t rows = height + (kind == PATTERN_GRADIENT || kind == PATTERN_NOISE ? extra_rows : 0);
+
+    // Everything is drawn in BGRA, and turned gray at the end if need be
+    vector<Pixel> bgra(size_t(width) * rows);
+    switch (kind)
+    {
+        case PATTERN_BARS:
+            for (uint32_t x = 0; x < width; ++x)
+                bgra[x] = bars[uint64_t(x) * 8 / width];
+            for (uint32_t y = 1; y < rows; ++y)
+                copy(&bgra[0], &bgra[width], &bgra[size_t(y) * width]);
+            break;
+        case PATTERN_GRADIENT:
+            // Repeats every extra_rows rows, so scrolling through them wraps
+            for (uint32_t y = 0; y < rows; ++y)
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    const byte h = uint64_t(x) * 255 / max<uint32_t>(width - 1, 1), v = y % extra_rows;
+                    bgra[size_t(y) * width + x] = RGB(h, v, 255 - h);
+                }
+            break;
+        case PATTERN_NOISE:
+            for (size_t i = 0; i < bgra.size(); ++i)
+            {
+                const uint32_t r = random();
+                bgra[i] = RGB(r, r >> 8, r >> 16);
+            }
+            break;
+        case PATTERN_SHAPES:
+            fill(bgra.begin(), bgra.end(), background);
+            break;
+    }
+
+    pitch = frameBytes(format, width, 1);
+    buffer.resize(pitch * rows);
+    convertFrame(FORMAT_BGRA32, reinterpret_cast<const byte*>(&bgra[0]), format, &buffer[0], width, rows);
+    offset = 0;
+    count  = 0;
+
+    shapes.clear();
+    if (kind == PATTERN_SHAPES)
+    {
+        const uint32_t small = min(width, height);
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            Shape s;
+            s.size   = max<uint32_t>(small / (6 + i), 1);
+            s.x      = random() % max<uint32_t>(width - s.size, 1);
+            s.y      = random() % max<uint32_t>(height - s.size, 1);
+            // Never still, so every frame has something to redraw
+            s.dx     = int32_t(random() % 4 + 1) * (random() & 1 ? 1 : -1);
+            s.dy     = int32_t(random() % 4 + 1) * (random() & 1 ? 1 : -1);
+            s.round  = i & 1;
+            s.colour = bars[i % 7];
+            shapes.push_back(s);
+            draw(s, false);
+        }
+    }
+}
+
+void Pattern::span(uint32_t y, int32_t x0, int32_t x1, Pixel colour)
+{
+    x0 = max<int32_t>(x0, 0);
+    x1 = min<int32_t>(x1, width);
+    if (x0 >= x1 || y >= height)
+        return;
+
+    byte *row = &buffer[y * pitch];
+    if (format == FORMAT_GRAY8)
+    {
+        byte g;
+        convertFrame(FORMAT_BGRA32, reinterpret_cast<const byte*>(&colour), FORMAT_GRAY8, &g, 1, 1);
+        memset(row + x0, g, x1 - x0);
+        return;
+    }
+
+    Pixel *p = reinterpret_cast<Pixel*>(row) + x0, *end = reinterpret_cast<Pixel*>(row) + x1;
+#ifdef __SSE2__
+    uint32_t value;
+    memcpy(&value, &colour, sizeof(value));
+    const __m128i v = _mm_set1_epi32(value);
+    for (; p + 4 <= end; p += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+#endif
+    for (; p < end; ++p)
+        *p = colour;
+}
+
+void Pattern::draw(const Shape &s, bool erase)
+{
+    const Pixel colour = erase ? background : s.colour;
+    const int32_t r = s.size / 2;
+    for (uint32_t y = 0; y < s.size; ++y)
+    {
+        int32_t from = 0, to = s.size;
+        if (s.round)
+        {
+            const int32_t d = int32_t(y) - r;
+            const int32_t half = int32_t(sqrt(double(r*r - d*d)));
+            from = r - half;
+            to   = r + half + 1;
+        }
+        span(s.y + y, s.x + from, s.x + to, colour);
+    }
+}
+
+const byte* Pattern::take(void)
+{
+    pace.wait();
+
+    // The first frame is as generated; after that, everything but the bars moves
+    if (count++ == 0)
+        changed = true;
+    else switch (kind)
+    {
+        case PATTERN_BARS:
+            changed = false;
+            break;
+        case PATTERN_GRADIENT:
+            offset = (count * 2 % extra_rows) * pitch;
+            break;
+        case PATTERN_NOISE:
+            offset = (random() % extra_rows) * pitch;
+            break;
+        case PATTERN_SHAPES:
+            for (vector<Shape>::iterator s = shapes.begin(); s != shapes.end(); ++s)
+                draw(*s, true);
+            for (vector<Shape>::iterator s = shapes.begin(); s != shapes.end(); ++s)
+            {
+                s->x += s->dx;
+                s->y += s->dy;
+                if (s->x < 0 || s->x + int32_t(s->size) > int32_t(width))
+                {
+                    s->dx = -s->dx;
+                    s->x += 2 * s->dx;
+                }
+                if (s->y < 0 || s->y + int32_t(s->size) > int32_t(height))
+                {
+                    s->dy = -s->dy;
+                    s->y += 2 * s->dy;
+                }
+                draw(*s, false);
+            }
+            break;
+    }
+    return &buffer[offset];
+}
+
+const byte* Pattern::acquireFrame(void)
+{
+    return take();
+}
+
+void Pattern::getFrame(byte *buf)
+{
+    memcpy(buf, take(), pitch * height);
+}
+
+bool Pattern::frameChanged(void) const
+{
+    return changed;
+}
+
+uint16_t Pattern::getBrightness(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Pattern::getHue(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Pattern::getColour(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Pattern::getContrast(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Pattern::getWhiteness(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+
+void Pattern::setBrightness(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Pattern::setHue(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Pattern::setColour(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Pattern::setContrast(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Pattern::setWhiteness(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
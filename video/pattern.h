@@ -0,0 +1,98 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <string>
+#include <vector>
+
+#include "../global.h"
+#include "../utils/pacer.h"
+#include "videodevice.h"
+
+enum PatternKind
+{
+    PATTERN_BARS,       // colour bars, which never change
+    PATTERN_GRADIENT,   // a gradient scrolling down
+    PATTERN_NOISE,      // noise, different every frame
+    PATTERN_SHAPES      // boxes and discs bouncing around
+};
+
+// Makes up frames, at any size and rate, for working the filters without a
+// camera. As little as possible is done per frame: bars, gradients and noise
+// are drawn once, a few rows taller than the frame, and each frame is lent
+// from a different row of that; shapes only redraw where they've moved.
+// Frames come in BGRA32 or GRAY8.
+class Pattern : public VideoDevice
+{
+    public:
+        /**
+         * @param name  pattern:bars, pattern:gradient, pattern:noise or
+         *              pattern:shapes
+         * @param fps   Frames per second. 0 is as fast as they're taken.
+         */
+        Pattern(const std::string &name, double fps);
+
+        /** Whether name names a pattern (pattern:...) */
+        static bool handles(const std::string &name);
+
+        /** Patterns are any size, and GRAY8 or (for anything else) BGRA32 */
+        void setParams(uint32_t width, uint32_t height, PixelFormat format);
+        void getFrame(byte *buf);
+        const byte* acquireFrame(void);
+        bool frameChanged(void) const;
+
+        uint16_t getBrightness(void) const;
+        uint16_t getHue(void)        const;
+        uint16_t getColour(void)     const;
+        uint16_t getContrast(void)   const;
+        uint16_t getWhiteness(void)  const;
+
+        void setBrightness(uint16_t);
+        void setHue(uint16_t);
+        void setColour(uint16_t);
+        void setContrast(uint16_t);
+        void setWhiteness(uint16_t);
+
+        // Extra rows drawn for scrolling and noise to move through
+        static const uint32_t extra_rows = 256;
+
+    private:
+        struct Shape
+        {
+            int32_t x, y, dx, dy;
+            uint32_t size;
+            bool round;
+            Pixel colour;
+        };
+
+        /** Draw whatever can be drawn ahead, for the current size and format */
+        void generate(void);
+        /** Pace, and move on to the next frame */
+        const byte* take(void);
+        /** Draw or rub out a shape */
+        void draw(const Shape &s, bool erase);
+        /** Fill pixels x0 to x1 of row y (in the current format) */
+        void span(uint32_t y, int32_t x0, int32_t x1, Pixel colour);
+        uint32_t random(void);
+
+        PatternKind kind;
+        // Hands frames out at the frame rate (if there is one)
+        novas0x2a::Pacer pace;
+        // The frames: a frame and then some, and where the current one starts
+        std::vector<byte> buffer;
+        size_t pitch, offset;
+        uint32_t count, seed;
+        bool changed;
+        std::vector<Shape> shapes;
+
+        explicit Pattern(const Pattern& original);
+        Pattern& operator=(const Pattern& original);
+};
+
+class PatternError : public VideoError
+{
+    public:
+        PatternError(const std::string& our_message) throw ():
+            VideoError(our_message) {};
+};
+
+#endif
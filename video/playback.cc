@@ -0,0 +1,449 @@
+#include <iostream>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../global.h"
+#include "playback.h"
+#include "netpbm.h"
+#include "convert.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    bool ends_with(const string &s, const char *suffix)
+    {
+        const size_t n = strlen(suffix);
+        return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+    }
+
+    // A sequence pattern takes exactly one integer, like %d or %04u
+    bool good_pattern(const string &p)
+    {
+        uint32_t conversions = 0;
+        for (string::size_type i = p.find('%'); i != string::npos; i = p.find('%', i))
+        {
+            ++i;
+            if (i < p.size() && p[i] == '%')
+            {
+                ++i;
+                continue;
+            }
+            while (i < p.size() && p[i] >= '0' && p[i] <= '9')
+                ++i;
+            if (i == p.size() || (p[i] != 'd' && p[i] != 'u' && p[i] != 'i'))
+                return false;
+            ++conversions;
+        }
+        return conversions == 1;
+    }
+}
+
+bool Playback::handles(const string &path)
+{
+    return path.find('%') != string::npos || ends_with(path, ".y4m") || ends_with(path, ".raw");
+}
+
+Playback::Playback(const char *file, double fps)
+    : path(file), pace(fps),
+      native_width(0), native_height(0), frames(0), first(0),
+      fd(-1), map(NULL), length(0), mono(false),
+      head(0), ready(0), next(0), running(false), stopping(false)
+{
+    Context c(string("While opening playback of ") + file);
+
+    if (path.find('%') != string::npos)
+        kind = SEQUENCE;
+    else if (ends_with(path, ".y4m"))
+        kind = Y4M;
+    else if (ends_with(path, ".raw"))
+        kind = RAW;
+    else
+        throw PlaybackError("Don't know how to play " + path + " (expected a %d pattern, .y4m or .raw)");
+
+    try {
+        if (kind == SEQUENCE)
+            openSequence();
+        else
+            openStream();
+    } catch (...) {
+        if (map)
+            munmap(map, length);
+        if (fd >= 0)
+            close(fd);
+        throw;
+    }
+
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&filled, NULL);
+    pthread_cond_init(&emptied, NULL);
+
+    width  = native_width;
+    height = native_height;
+    depth  = 32;
+    format = FORMAT_BGRA32;
+}
+
+Playback::~Playback(void)
+{
+    Context c("While closing playback");
+    stop();
+    pthread_cond_destroy(&emptied);
+    pthread_cond_destroy(&filled);
+    pthread_mutex_destroy(&lock);
+    if (map)
+        munmap(map, length);
+    if (fd >= 0)
+        close(fd);
+}
+
+string Playback::frameName(uint32_t i) const
+{
+    char name[4096];
+    snprintf(name, sizeof(name), path.c_str(), i);
+    return name;
+}
+
+void Playback::openSequence(void)
+{
+    if (!good_pattern(path))
+        throw PlaybackError(path + " should have exactly one integer conversion (like %04d) in it");
+
+    // Numbering starts at 0 or 1, and stops at the first gap
+    first = access(frameName(0).c_str(), R_OK) == 0 ? 0 : 1;
+    for (frames = 0; access(frameName(first + frames).c_str(), R_OK) == 0; ++frames)
+        ;
+    if (frames == 0)
+        throw PlaybackError("No frames match " + path);
+
+    Netpbm img(frameName(first).c_str());
+    native_width  = img.getWidth();
+    native_height = img.getHeight();
+}
+
+void Playback::openStream(void)
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw PlaybackError("Could not open " + path + " (" + strerror(errno) + ")");
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        throw PlaybackError("Could not stat " + path + " (" + strerror(errno) + ")");
+    length = st.st_size;
+    if (length == 0)
+        throw PlaybackError(path + " is empty");
+
+    void *m = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED)
+        throw PlaybackError("Could not map " + path + " (" + strerror(errno) + ")");
+    map = static_cast<byte*>(m);
+    madvise(map, length, MADV_SEQUENTIAL);
+
+    // Raw streams don't know their size until setParams
+    if (kind == Y4M)
+        parseY4M();
+}
+
+// YUV4MPEG2 W<width> H<height> [F, A, I, X...] C<colorspace>\n
+// then FRAME[ params]\n<planes>, over and over
+void Playback::parseY4M(void)
+{
+    const byte *p = map, *end = map + length;
+    const byte *eol = static_cast<const byte*>(memchr(p, '\n', length));
+    if (!eol || length < 9 || memcmp(p, "YUV4MPEG2", 9) != 0)
+        throw PlaybackError(path + " isn't a YUV4MPEG2 stream");
+
+    string colorspace("420");
+    char word[64];
+    for (p += 9; p < eol; )
+    {
+        while (p < eol && *p == ' ')
+            ++p;
+        size_t n = 0;
+        for (; p < eol && *p != ' '; ++p)
+            if (n + 1 < sizeof(word))
+                word[n++] = *p;
+        word[n] = 0;
+        if (n == 0)
+            continue;
+
+        switch (word[0])
+        {
+            case 'W': native_width  = strtoul(word+1, NULL, 10); break;
+            case 'H': native_height = strtoul(word+1, NULL, 10); break;
+            case 'C': colorspace = word+1;                       break;
+            default:  break; // rate, aspect and interlacing don't matter here
+        }
+    }
+    if (native_width == 0 || native_height == 0)
+        throw PlaybackError(path + " doesn't say how big its frames are");
+
+    size_t frame_bytes = size_t(native_width) * native_height;
+    if (colorspace == "mono")
+        mono = true;
+    else if (colorspace.compare(0, 3, "420") == 0)
+        frame_bytes += 2 * size_t((native_width+1)/2) * ((native_height+1)/2);
+    else
+        throw PlaybackError(path + ": can't play colorspace C" + colorspace + " (only 4:2:0 and mono)");
+
+    // A truncated last frame gets dropped
+    for (p = eol + 1; end - p >= 5 && memcmp(p, "FRAME", 5) == 0; )
+    {
+        eol = static_cast<const byte*>(memchr(p, '\n', end - p));
+        if (!eol || size_t(end - (eol + 1)) < frame_bytes)
+            break;
+        offsets.push_back(eol + 1 - map);
+        p = eol + 1 + frame_bytes;
+    }
+    frames = offsets.size();
+    if (frames == 0)
+        throw PlaybackError(path + " has no frames");
+}
+
+void Playback::setParams(uint32_t width, uint32_t height, PixelFormat format)
+{
+    Context c("While setting Playback params (" + stringify(width) + "," + stringify(height) + " " + formatInfo(format).name + ")");
+    // Everything is decoded to BGRA by the read-ahead thread
+    stop();
+
+    if (kind == RAW)
+    {
+        frames = length / (size_t(width) * height * sizeof(Pixel));
+        if (frames == 0)
+            throw PlaybackError(path + " doesn't have even one " + stringify(width) + "x" + stringify(height) + " frame in it");
+        native_width  = width;
+        native_height = height;
+        next = 0;
+    }
+
+    // Anything else plays at its own size, and the window scales it
+    this->width  = native_width;
+    this->height = native_height;
+}
+
+void Playback::start(void)
+{
+    if (likely(running))
+        return;
+
+    ring.resize(depth_ahead);
+    for (uint32_t i = 0; i < ring.size(); ++i)
+        ring[i] = new Pixel[native_width * native_height];
+    head = ready = 0;
+    error.clear();
+
+    if (pthread_create(&thread, NULL, run, this) != 0)
+        throw PlaybackError("Couldn't start the read-ahead thread");
+    running = true;
+}
+
+void Playback::stop(void)
+{
+    if (!running)
+        return;
+
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&emptied);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+
+    for (uint32_t i = 0; i < ring.size(); ++i)
+        delete [] ring[i];
+    ring.clear();
+    running  = false;
+    stopping = false;
+}
+
+void* Playback::run(void *self)
+{
+    static_cast<Playback*>(self)->readAhead();
+    return NULL;
+}
+
+void Playback::readAhead(void)
+{
+    Context c("While reading ahead in " + path);
+    for (;;)
+    {
+        pthread_mutex_lock(&lock);
+        while (ready == ring.size() && !stopping)
+            pthread_cond_wait(&emptied, &lock);
+        if (stopping)
+        {
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+        Pixel *slot = ring[(head + ready) % ring.size()];
+        const uint32_t i = next;
+        pthread_mutex_unlock(&lock);
+
+        try {
+            prefetch((i + depth_ahead) % frames);
+            decode(i, slot);
+        } catch (const Exception &e) {
+            pthread_mutex_lock(&lock);
+            error = e.message();
+            pthread_cond_signal(&filled);
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+
+        pthread_mutex_lock(&lock);
+        next = (i + 1) % frames;
+        ++ready;
+        pthread_cond_signal(&filled);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void Playback::prefetch(uint32_t i)
+{
+    if (kind == SEQUENCE)
+    {
+        // Start the kernel reading the file in
+        int f = open(frameName(first + i).c_str(), O_RDONLY);
+        if (f >= 0)
+        {
+            posix_fadvise(f, 0, 0, POSIX_FADV_WILLNEED);
+            close(f);
+        }
+        return;
+    }
+
+    const size_t frame_bytes = kind == RAW ? size_t(native_width) * native_height * sizeof(Pixel)
+                                           : (i + 1 < frames ? offsets[i+1] : length) - offsets[i];
+    const size_t start = kind == RAW ? i * frame_bytes : offsets[i];
+    // madvise wants a page-aligned start
+    const size_t page  = sysconf(_SC_PAGESIZE);
+    const size_t begin = start & ~(page - 1);
+    madvise(map + begin, min(length - begin, frame_bytes + (start - begin)), MADV_WILLNEED);
+}
+
+void Playback::decode(uint32_t i, Pixel *out)
+{
+    const uint32_t count = native_width * native_height;
+    switch (kind)
+    {
+        case SEQUENCE:
+        {
+            Netpbm img(frameName(first + i).c_str());
+            if (img.getWidth() != native_width || img.getHeight() != native_height)
+                throw PlaybackError(frameName(first + i) + " isn't the same size as the first frame");
+            img.toBGRA(out);
+            break;
+        }
+        case Y4M:
+        {
+            const byte *y = map + offsets[i];
+            if (mono)
+                gray8_to_bgra(y, out, count);
+            else
+            {
+                const byte *u = y + count, *v = u + ((native_width+1)/2) * ((native_height+1)/2);
+                i420_to_bgra(y, u, v, out, native_width, native_height);
+            }
+            break;
+        }
+        case RAW:
+            memcpy(out, map + size_t(i) * count * sizeof(Pixel), count * sizeof(Pixel));
+            break;
+    }
+}
+
+const Pixel* Playback::take(void)
+{
+    start();
+
+    pthread_mutex_lock(&lock);
+    while (ready == 0 && error.empty())
+        pthread_cond_wait(&filled, &lock);
+    if (unlikely(!error.empty()))
+    {
+        const string e = error;
+        pthread_mutex_unlock(&lock);
+        throw PlaybackError(e);
+    }
+    const Pixel *frame = ring[head];
+    pthread_mutex_unlock(&lock);
+
+    pace.wait();
+    return frame;
+}
+
+void Playback::give(void)
+{
+    pthread_mutex_lock(&lock);
+    head = (head + 1) % ring.size();
+    --ready;
+    pthread_cond_signal(&emptied);
+    pthread_mutex_unlock(&lock);
+}
+
+const byte* Playback::acquireFrame(void)
+{
+    return reinterpret_cast<const byte*>(take());
+}
+
+void Playback::releaseFrame(void)
+{
+    give();
+}
+
+void Playback::getFrame(byte *buf)
+{
+    memcpy(buf, take(), width*height*sizeof(Pixel));
+    give();
+}
+
+uint16_t Playback::getBrightness(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Playback::getHue(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Playback::getColour(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Playback::getContrast(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Playback::getWhiteness(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+
+void Playback::setBrightness(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Playback::setHue(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Playback::setColour(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Playback::setContrast(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Playback::setWhiteness(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
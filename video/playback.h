@@ -0,0 +1,115 @@
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "../global.h"
+#include "../utils/pacer.h"
+#include "videodevice.h"
+
+// Plays back recorded frames: a numbered run of PPMs/PGMs, a Y4M stream, or a
+// raw stream of BGRA frames. A thread decodes a few frames ahead, and the
+// whole thing loops, so it can feed a graph forever.
+class Playback : public VideoDevice
+{
+    public:
+        /**
+         * Open a recording. What kind it is goes by the name:
+         *   - anything with a printf-style number in it (frame%04d.ppm) is a
+         *     sequence of stills, starting at 0 or 1
+         *   - *.y4m is a YUV4MPEG2 stream (4:2:0 or mono)
+         *   - *.raw is a stream of BGRA frames, sized by setParams
+         * @param path  Path to the recording
+         * @param fps   Frames per second to play at. 0 is as fast as possible.
+         */
+        Playback(const char *path, double fps);
+        ~Playback(void);
+
+        /** Whether path names something Playback can play (by its name) */
+        static bool handles(const std::string &path);
+
+        void setParams(uint32_t width, uint32_t height, PixelFormat format);
+        void getFrame(byte *buf);
+        const byte* acquireFrame(void);
+        void releaseFrame(void);
+
+        uint16_t getBrightness(void) const;
+        uint16_t getHue(void)        const;
+        uint16_t getColour(void)     const;
+        uint16_t getContrast(void)   const;
+        uint16_t getWhiteness(void)  const;
+
+        void setBrightness(uint16_t);
+        void setHue(uint16_t);
+        void setColour(uint16_t);
+        void setContrast(uint16_t);
+        void setWhiteness(uint16_t);
+
+        // How many frames are decoded ahead
+        static const uint32_t depth_ahead = 4;
+
+    private:
+        enum Kind {SEQUENCE, Y4M, RAW};
+
+        /** Find the frames in a sequence or stream, and their size */
+        void openSequence(void);
+        void openStream(void);
+        void parseY4M(void);
+
+        /** Start the read-ahead thread, if it isn't going yet */
+        void start(void);
+        void stop(void);
+        static void* run(void *self);
+        void readAhead(void);
+
+        /** Wait for the frame at head (pacing it), and hand it back when done */
+        const Pixel* take(void);
+        void give(void);
+
+        /** Decode frame number i into out (native size, BGRA) */
+        void decode(uint32_t i, Pixel *out);
+        /** Hint to the kernel that frame i is coming up */
+        void prefetch(uint32_t i);
+        std::string frameName(uint32_t i) const;
+
+        const std::string path;
+        Kind kind;
+        // Hands frames out at the frame rate (if there is one)
+        novas0x2a::Pacer pace;
+
+        // Native frame size, and how many frames there are
+        uint32_t native_width, native_height, frames;
+        // Sequences: the first number. Streams: the mapping, and where each
+        // frame's data starts
+        uint32_t first;
+        int fd;
+        byte *map;
+        size_t length;
+        std::vector<size_t> offsets;
+        bool mono;
+
+        // The read-ahead ring. The reader thread fills slots after the ready
+        // ones; getFrame empties them from head.
+        std::vector<Pixel*> ring;
+        uint32_t head, ready, next;
+        bool running, stopping;
+        std::string error;
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t filled, emptied;
+
+        explicit Playback(const Playback& original);
+        Playback& operator=(const Playback& original);
+};
+
+class PlaybackError : public VideoError
+{
+    public:
+        PlaybackError(const std::string& our_message) throw ():
+            VideoError(our_message) {};
+};
+
+#endif
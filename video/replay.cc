@@ -0,0 +1,234 @@
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include "../global.h"
+#include "../utils/clock.h"
+#include "replay.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+bool Replay::handles(const string &path)
+{
+    return path.size() >= 4 && path.compare(path.size() - 4, 4, ".cap") == 0;
+}
+
+Replay::Replay(const char *file, bool realtime)
+    : path(file), realtime(realtime), fd(-1), map(NULL), length(0), index(NULL), frames(0),
+      next(0), last(0), changed(true), base(0), stamp(0)
+{
+    Context c(string("While opening the capture ") + file);
+
+    try {
+        fd = open(file, O_RDONLY);
+        if (fd < 0)
+            throw ReplayError("Could not open " + path + " (" + strerror(errno) + ")");
+
+        struct stat st;
+        if (fstat(fd, &st) < 0)
+            throw ReplayError("Could not stat " + path + " (" + strerror(errno) + ")");
+        length = st.st_size;
+        if (length < sizeof(CaptureHeader))
+            throw ReplayError(path + " is too short to be a capture");
+
+        void *m = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED)
+            throw ReplayError("Could not map " + path + " (" + strerror(errno) + ")");
+        map = static_cast<byte*>(m);
+
+        const CaptureHeader *h = reinterpret_cast<const CaptureHeader*>(map);
+        if (memcmp(h->magic, CAPTURE_MAGIC, sizeof(h->magic)) != 0)
+            throw ReplayError(path + " isn't a capture");
+        if (h->format >= FORMAT_COUNT || h->width == 0 || h->height == 0)
+            throw ReplayError(path + " has a bad header");
+        if (h->index == 0)
+        {
+            recover();
+            cerr << path << " was never finished; found " << frames << " frames in it" << endl;
+        }
+        else
+        {
+            if (h->index > length || (length - h->index) / sizeof(CaptureEntry) < h->frames)
+                throw ReplayError(path + " is truncated");
+            frames = h->frames;
+            index  = reinterpret_cast<const CaptureEntry*>(map + h->index);
+        }
+        if (frames == 0)
+            throw ReplayError(path + " has no frames");
+
+        width  = h->width;
+        height = h->height;
+        format = PixelFormat(h->format);
+        depth  = formatInfo(format).depth;
+
+        const size_t bytes = frameBytes(format, width, height);
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            const CaptureEntry &e = index[i];
+            if (e.offset > length || length - e.offset < e.size)
+                throw ReplayError(path + ": frame " + stringify(i) + " is past the end of the file");
+            if (e.flags & CAPTURE_LZ4)
+            {
+#ifndef HAVE_LZ4
+                throw ReplayError(path + " is compressed, and this wasn't built with LZ4");
+#endif
+            }
+            else if (e.size != bytes)
+                throw ReplayError(path + ": frame " + stringify(i) + " is the wrong size");
+        }
+    } catch (...) {
+        if (map)
+            munmap(map, length);
+        if (fd >= 0)
+            close(fd);
+        throw;
+    }
+
+    madvise(map, length, MADV_SEQUENTIAL);
+}
+
+void Replay::recover(void)
+{
+    // Records follow one another from just after the header. The first one
+    // that isn't there (or has no whole frame) is where the capture stopped.
+    uint64_t at = sizeof(CaptureHeader);
+    while (at <= length && length - at >= sizeof(CaptureRecord))
+    {
+        const CaptureRecord *r = reinterpret_cast<const CaptureRecord*>(map + at);
+        if (memcmp(r->magic, CAPTURE_RECORD_MAGIC, sizeof(r->magic)) != 0 || r->next <= at ||
+            r->entry.offset > length || length - r->entry.offset < r->entry.size)
+            break;
+        recovered.push_back(r->entry);
+        at = r->next;
+    }
+    frames = recovered.size();
+    index  = recovered.empty() ? NULL : &recovered[0];
+}
+
+Replay::~Replay(void)
+{
+    munmap(map, length);
+    close(fd);
+}
+
+void Replay::setParams(uint32_t, uint32_t, PixelFormat)
+{
+    // A replay is only a replay if nothing about it changes
+}
+
+const byte* Replay::take(void)
+{
+    const uint32_t i = next;
+    const CaptureEntry &e = index[i];
+
+    if (realtime)
+    {
+        // Each time round starts now. If we've fallen behind, carry on from
+        // here rather than rushing the frames after to catch up.
+        const uint64_t now = monotonic_ns();
+        if (i == 0 || now > base + e.time)
+            base = now - e.time;
+        else
+            sleep_until(base + e.time);
+        stamp = base + e.time;
+    }
+    else
+        stamp = monotonic_ns();
+
+    changed = e.offset != last;
+    last = e.offset;
+    next = (i + 1) % frames;
+
+    if (likely(!(e.flags & CAPTURE_LZ4)))
+        return map + e.offset;
+
+#ifdef HAVE_LZ4
+    // A repeat of a compressed frame is still unpacked from last time
+    const size_t bytes = frameBytes(format, width, height);
+    if (changed || unpacked.size() != bytes)
+    {
+        unpacked.resize(bytes);
+        const int n = LZ4_decompress_safe(reinterpret_cast<const char*>(map + e.offset), reinterpret_cast<char*>(&unpacked[0]), e.size, bytes);
+        if (n < 0 || size_t(n) != bytes)
+            throw ReplayError(path + ": frame " + stringify(i) + " is corrupt");
+    }
+#endif
+    return &unpacked[0];
+}
+
+const byte* Replay::acquireFrame(void)
+{
+    return take();
+}
+
+void Replay::releaseFrame(void)
+{
+}
+
+void Replay::getFrame(byte *buf)
+{
+    memcpy(buf, take(), frameBytes(format, width, height));
+}
+
+bool Replay::frameChanged(void) const
+{
+    return changed;
+}
+
+uint64_t Replay::getTimestamp(void) const
+{
+    return stamp;
+}
+
+uint16_t Replay::getBrightness(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Replay::getHue(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Replay::getColour(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Replay::getContrast(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t Replay::getWhiteness(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+
+void Replay::setBrightness(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Replay::setHue(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Replay::setColour(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Replay::setContrast(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void Replay::setWhiteness(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
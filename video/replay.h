@@ -0,0 +1,90 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <string>
+#include <vector>
+
+#include "../global.h"
+#include "videodevice.h"
+#include "capture.h"
+
+// Plays a capture (see capture.h) back exactly as it was recorded: same
+// frames, same size and format, and either the same timing or as fast as
+// they can be taken. The file is mapped, and uncompressed frames are lent
+// straight out of the mapping, so replaying copies nothing. It loops.
+class Replay : public VideoDevice
+{
+    public:
+        /**
+         * @param path      the capture
+         * @param realtime  hand frames out at the times they were captured,
+         *                  rather than as fast as they're asked for
+         */
+        Replay(const char *path, bool realtime = true);
+        ~Replay(void);
+
+        /** Whether path names a capture (*.cap) */
+        static bool handles(const std::string &path);
+
+        /** Captures play at the size and format they were made at, whatever is asked for */
+        void setParams(uint32_t width, uint32_t height, PixelFormat format);
+        void getFrame(byte *buf);
+        const byte* acquireFrame(void);
+        void releaseFrame(void);
+        bool frameChanged(void) const;
+        /** When the frame was played: its capture time, moved to now */
+        uint64_t getTimestamp(void) const;
+
+        inline uint32_t getFrames(void) const {return frames;};
+
+        uint16_t getBrightness(void) const;
+        uint16_t getHue(void)        const;
+        uint16_t getColour(void)     const;
+        uint16_t getContrast(void)   const;
+        uint16_t getWhiteness(void)  const;
+
+        void setBrightness(uint16_t);
+        void setHue(uint16_t);
+        void setColour(uint16_t);
+        void setContrast(uint16_t);
+        void setWhiteness(uint16_t);
+
+    private:
+        /** Wait for frame next to be due, and find its pixels */
+        const byte* take(void);
+        /** Rebuild the index of a capture that was never closed from its frame records */
+        void recover(void);
+
+        const std::string path;
+        const bool realtime;
+        int fd;
+        byte *map;
+        size_t length;
+        const CaptureEntry *index;
+        uint32_t frames;
+        // The index, when it had to be rebuilt
+        std::vector<CaptureEntry> recovered;
+
+        // The next frame, and the offset of the one before (to tell repeats;
+        // no frame is at 0)
+        uint32_t next;
+        uint64_t last;
+        bool changed;
+        // Monotonic time frame 0 is played at this time round, and the
+        // time the last frame was played
+        uint64_t base, stamp;
+        // Compressed frames are unpacked here
+        std::vector<byte> unpacked;
+
+        explicit Replay(const Replay& original);
+        Replay& operator=(const Replay& original);
+};
+
+class ReplayError : public VideoError
+{
+    public:
+        ReplayError(const std::string& our_message) throw ():
+            VideoError(our_message) {};
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "../global.h"
+#include "resample.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    // Weights are fixed point with this many fraction bits
+    const int32_t precision = 14;
+    const int32_t one = 1 << precision;
+
+    double sinc(double x)
+    {
+        if (x == 0)
+            return 1;
+        x *= M_PI;
+        return sin(x) / x;
+    }
+
+    double tent(double x)
+    {
+        x = fabs(x);
+        return x < 1 ? 1 - x : 0;
+    }
+
+    double lanczos(double x)
+    {
+        return fabs(x) < 3 ? sinc(x) * sinc(x / 3) : 0;
+    }
+
+    inline byte clamp(int32_t x)
+    {
+        return x < 0 ? 0 : x > 255 ? 255 : x;
+    }
+}
+
+ResampleMethod resampleByName(const string &name)
+{
+    if (name == "area")
+        return RESAMPLE_AREA;
+    if (name == "bilinear")
+        return RESAMPLE_BILINEAR;
+    if (name == "lanczos")
+        return RESAMPLE_LANCZOS;
+    throw ArgumentError("Unknown resampling method " + name);
+}
+
+Resampler::Resampler(uint32_t in_width, uint32_t in_height, uint32_t out_width, uint32_t out_height, ResampleMethod method) :
+    in_width(in_width), in_height(in_height), out_width(out_width), out_height(out_height)
+{
+    Context c("While setting up to scale " + stringify(in_width) + "x" + stringify(in_height)
+            + " to " + stringify(out_width) + "x" + stringify(out_height));
+    if (!in_width || !in_height || !out_width || !out_height)
+        throw ArgumentError("Can't scale to or from nothing");
+    build(h, in_width, out_width, method);
+    build(v, in_height, out_height, method);
+}
+
+void Resampler::build(Taps &t, uint32_t in, uint32_t out, ResampleMethod method)
+{
+    const double scale = double(in) / out;
+    // Shrinking widens the filter, so every input pixel counts for something
+    const double stretch = max(scale, 1.0);
+    const double support = (method == RESAMPLE_LANCZOS ? 3 : 1) * stretch;
+
+    vector<vector<double> > w(out);
+    vector<int32_t> first(out);
+    t.taps = 1;
+    for (uint32_t x = 0; x < out; ++x)
+    {
+        const double a = x * scale, b = (x + 1) * scale, center = (a + b) / 2;
+        int32_t lo, hi;
+        if (method == RESAMPLE_AREA)
+            lo = int32_t(floor(a)), hi = int32_t(ceil(b));
+        else
+            lo = int32_t(floor(center - support)), hi = int32_t(ceil(center + support));
+        lo = max(lo, 0);
+        hi = min(hi, int32_t(in));
+
+        double sum = 0;
+        for (int32_t i = lo; i < hi; ++i)
+        {
+            double k;
+            if (method == RESAMPLE_AREA)
+                k = min(i + 1.0, b) - max(double(i), a);
+            else if (method == RESAMPLE_BILINEAR)
+                k = tent((i + 0.5 - center) / stretch);
+            else
+                k = lanczos((i + 0.5 - center) / stretch);
+            w[x].push_back(k);
+            sum += k;
+        }
+        // Only possible at the very edge; take the nearest pixel
+        if (sum == 0)
+        {
+            lo = min(max(int32_t(center), 0), int32_t(in) - 1);
+            w[x].assign(1, 1.0);
+            sum = 1;
+        }
+        for (size_t i = 0; i < w[x].size(); ++i)
+            w[x][i] /= sum;
+
+        first[x] = lo;
+        t.taps = max<uint32_t>(t.taps, w[x].size());
+    }
+
+    // Every output gets the same number of taps, so windows near the right
+    // edge are slid left to stay inside, and padded with zeros
+    t.start.resize(out);
+    t.weights.assign(size_t(out) * t.taps, 0);
+    for (uint32_t x = 0; x < out; ++x)
+    {
+        const uint32_t start = min<uint32_t>(first[x], in - t.taps);
+        int16_t *q = &t.weights[size_t(x) * t.taps + (first[x] - start)];
+        int32_t total = 0;
+        size_t biggest = 0;
+        for (size_t i = 0; i < w[x].size(); ++i)
+        {
+            q[i] = int16_t(floor(w[x][i] * one + 0.5));
+            total += q[i];
+            if (abs(q[i]) > abs(q[biggest]))
+                biggest = i;
+        }
+        // Rounding mustn't change the brightness
+        q[biggest] += one - total;
+        t.start[x] = start;
+    }
+}
+
+void Resampler::horizontal(const byte *in, byte *out, uint32_t rows, uint32_t channels)
+{
+    const uint32_t taps = h.taps;
+    for (uint32_t y = 0; y < rows; ++y)
+    {
+        const byte *row = in + size_t(y) * in_width * channels;
+        byte *o = out + size_t(y) * out_width * channels;
+#ifdef __SSE2__
+        if (channels == 4)
+        {
+            // One pixel at a time, two taps a go: the two pixels' channels are
+            // interleaved so one madd does both taps for all four channels
+            const __m128i zero = _mm_setzero_si128();
+            for (uint32_t x = 0; x < out_width; ++x)
+            {
+                const byte *p = row + size_t(h.start[x]) * 4;
+                const int16_t *w = &h.weights[size_t(x) * taps];
+                __m128i acc = _mm_set1_epi32(one / 2);
+                uint32_t k = 0;
+                for (; k + 2 <= taps; k += 2)
+                {
+                    int32_t a, b;
+                    memcpy(&a, p + k*4, 4);
+                    memcpy(&b, p + k*4 + 4, 4);
+                    const __m128i pa = _mm_unpacklo_epi8(_mm_cvtsi32_si128(a), zero);
+                    const __m128i pb = _mm_unpacklo_epi8(_mm_cvtsi32_si128(b), zero);
+                    const __m128i wk = _mm_set1_epi32(int32_t(uint16_t(w[k]) | (uint32_t(uint16_t(w[k+1])) << 16)));
+                    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(pa, pb), wk));
+                }
+                if (k < taps)
+                {
+                    int32_t a;
+                    memcpy(&a, p + k*4, 4);
+                    const __m128i pa = _mm_unpacklo_epi8(_mm_cvtsi32_si128(a), zero);
+                    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(pa, zero), _mm_set1_epi32(uint16_t(w[k]))));
+                }
+                acc = _mm_srai_epi32(acc, precision);
+                acc = _mm_packs_epi32(acc, acc);
+                const int32_t px = _mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+                memcpy(o + size_t(x) * 4, &px, 4);
+            }
+            continue;
+        }
+#endif
+        for (uint32_t x = 0; x < out_width; ++x)
+        {
+            const byte *p = row + size_t(h.start[x]) * channels;
+            const int16_t *w = &h.weights[size_t(x) * taps];
+            for (uint32_t c = 0; c < channels; ++c)
+            {
+                int32_t acc = one / 2;
+                for (uint32_t k = 0; k < taps; ++k)
+                    acc += w[k] * p[k*channels + c];
+                o[x*channels + c] = clamp(acc >> precision);
+            }
+        }
+    }
+}
+
+void Resampler::vertical(const byte *in, byte *out, size_t row_bytes)
+{
+    const uint32_t taps = v.taps;
+    for (uint32_t y = 0; y < out_height; ++y)
+    {
+        const byte *first = in + size_t(v.start[y]) * row_bytes;
+        const int16_t *w = &v.weights[size_t(y) * taps];
+        byte *o = out + size_t(y) * row_bytes;
+        size_t i = 0;
+#ifdef __SSE2__
+        // Sixteen bytes across at a time, whatever the pixels are: each
+        // byte only ever mixes with the same byte of the rows around it
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= row_bytes; i += 16)
+        {
+            __m128i acc[4];
+            for (uint32_t j = 0; j < 4; ++j)
+                acc[j] = _mm_set1_epi32(one / 2);
+            for (uint32_t k = 0; k < taps; k += 2)
+            {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + k*row_bytes + i));
+                // An odd last tap pairs with itself, at zero weight
+                const uint32_t k1 = k + 1 < taps ? k + 1 : k;
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + k1*row_bytes + i));
+                const int16_t w1 = k + 1 < taps ? w[k+1] : 0;
+                const __m128i wk = _mm_set1_epi32(int32_t(uint16_t(w[k]) | (uint32_t(uint16_t(w1)) << 16)));
+                const __m128i al = _mm_unpacklo_epi8(a, zero), ah = _mm_unpackhi_epi8(a, zero);
+                const __m128i bl = _mm_unpacklo_epi8(b, zero), bh = _mm_unpackhi_epi8(b, zero);
+                acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_unpacklo_epi16(al, bl), wk));
+                acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_unpackhi_epi16(al, bl), wk));
+                acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_unpacklo_epi16(ah, bh), wk));
+                acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_unpackhi_epi16(ah, bh), wk));
+            }
+            for (uint32_t j = 0; j < 4; ++j)
+                acc[j] = _mm_srai_epi32(acc[j], precision);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i),
+                    _mm_packus_epi16(_mm_packs_epi32(acc[0], acc[1]), _mm_packs_epi32(acc[2], acc[3])));
+        }
+#endif
+        for (; i < row_bytes; ++i)
+        {
+            int32_t acc = one / 2;
+            for (uint32_t k = 0; k < taps; ++k)
+                acc += w[k] * first[k*row_bytes + i];
+            o[i] = clamp(acc >> precision);
+        }
+    }
+}
+
+void Resampler::scale(const byte *in, byte *out, uint32_t channels)
+{
+    const bool across = in_width != out_width, down = in_height != out_height;
+    if (!across && !down)
+        memcpy(out, in, size_t(in_width) * in_height * channels);
+    else if (!down)
+        horizontal(in, out, in_height, channels);
+    else if (!across)
+        vertical(in, out, size_t(out_width) * channels);
+    else if (channels == 1 && out_height < in_height)
+    {
+        // Gray rows are done a pixel at a time, but columns sixteen at a
+        // time, so shrinking columns first leaves fewer rows to do
+        tmp.resize(size_t(in_width) * out_height);
+        vertical(in, &tmp[0], in_width);
+        horizontal(&tmp[0], out, out_height, 1);
+    }
+    else
+    {
+        tmp.resize(size_t(out_width) * in_height * channels);
+        horizontal(in, &tmp[0], in_height, channels);
+        vertical(&tmp[0], out, size_t(out_width) * channels);
+    }
+}
+
+void Resampler::run(const Pixel *in, Pixel *out)
+{
+    scale(reinterpret_cast<const byte*>(in), reinterpret_cast<byte*>(out), sizeof(Pixel));
+}
+
+void Resampler::run(const byte *in, byte *out)
+{
+    scale(in, out, 1);
+}
@@ -0,0 +1,84 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <string>
+#include <vector>
+#include "../global.h"
+
+enum ResampleMethod
+{
+    // Average of everything under each output pixel. Best for shrinking.
+    RESAMPLE_AREA,
+    // Tent filter, widened when shrinking so nothing is skipped
+    RESAMPLE_BILINEAR,
+    // Windowed sinc with three lobes. Sharpest, and the slowest.
+    RESAMPLE_LANCZOS
+};
+
+/**
+ * Look a method up by name (area, bilinear, lanczos)
+ * @throw ArgumentError if there's no such method
+ */
+ResampleMethod resampleByName(const std::string &name);
+
+// Scales frames of one size to another. The filter coefficients are worked
+// out once, up front, so a Resampler is meant to be kept around and used on
+// frame after frame. Rows are done first, then columns (the other way round
+// when gray is shrinking down); both passes use 2.14 fixed point and SSE2
+// where there is some.
+class Resampler
+{
+    public:
+        /**
+         * @param in_width      size of the frames going in
+         * @param in_height
+         * @param out_width     size of the frames coming out
+         * @param out_height
+         * @param method        how to filter
+         */
+        Resampler(uint32_t in_width, uint32_t in_height, uint32_t out_width, uint32_t out_height, ResampleMethod method);
+
+        /**
+         * Scale a BGRA frame
+         * @param in    in_width*in_height pixels
+         * @param out   out_width*out_height pixels
+         */
+        void run(const Pixel *in, Pixel *out);
+
+        /**
+         * Scale an 8-bit gray frame
+         * @param in    in_width*in_height bytes
+         * @param out   out_width*out_height bytes
+         */
+        void run(const byte *in, byte *out);
+
+        inline uint32_t getInWidth(void)   const {return in_width;};
+        inline uint32_t getInHeight(void)  const {return in_height;};
+        inline uint32_t getOutWidth(void)  const {return out_width;};
+        inline uint32_t getOutHeight(void) const {return out_height;};
+
+    private:
+        // Coefficients for one direction. Output i is the sum over k < taps
+        // of weights[i*taps + k] times input start[i] + k.
+        struct Taps
+        {
+            uint32_t taps;
+            std::vector<uint32_t> start;
+            std::vector<int16_t> weights;
+        };
+
+        static void build(Taps &t, uint32_t in, uint32_t out, ResampleMethod method);
+
+        /** Scale rows rows of channels-byte pixels horizontally */
+        void horizontal(const byte *in, byte *out, uint32_t rows, uint32_t channels);
+        /** Scale columns of row_bytes-wide rows vertically */
+        void vertical(const byte *in, byte *out, size_t row_bytes);
+        void scale(const byte *in, byte *out, uint32_t channels);
+
+        const uint32_t in_width, in_height, out_width, out_height;
+        Taps h, v;
+        // One pass done but not the other
+        std::vector<byte> tmp;
+};
+
+#endif
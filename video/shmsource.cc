@@ -0,0 +1,124 @@
+#include <iostream>
+#include <cstring>
+
+#include "../global.h"
+#include "shmsource.h"
+
+using namespace std;
+using namespace novas0x2a;
+
+namespace
+{
+    const char prefix[] = "shm:";
+
+    // shm_open names start with a slash; let people leave it off
+    string ring_name(const string &name)
+    {
+        const string n = name.substr(sizeof(prefix) - 1);
+        return n.empty() || n[0] != '/' ? "/" + n : n;
+    }
+}
+
+bool SharedSource::handles(const string &name)
+{
+    return name.compare(0, sizeof(prefix) - 1, prefix) == 0;
+}
+
+SharedSource::SharedSource(const string &name)
+    : ring(ring_name(name)), changed(false)
+{
+    width  = ring.getWidth();
+    height = ring.getHeight();
+    format = ring.getFormat();
+    depth  = formatInfo(format).depth;
+}
+
+SharedSource::~SharedSource(void)
+{
+    cerr << "Took " << ring.getTaken() << " frames from shared memory ("
+         << ring.getSkipped() << " skipped to catch up, "
+         << ring.getTorn() << " overwritten while in use)" << endl;
+}
+
+void SharedSource::setParams(uint32_t, uint32_t, PixelFormat)
+{
+    // Whoever writes the ring decides. The window is always given a size
+    // (176x144 if nothing else), so there's no telling a real mismatch.
+}
+
+const byte* SharedSource::acquireFrame(void)
+{
+    // Nothing new in time means the writer is slow or gone. Either way the
+    // window carries on with what it has, and asks again next time round.
+    const byte *frame = ring.acquire(patience);
+    changed = frame != NULL;
+    return frame;
+}
+
+void SharedSource::releaseFrame(void)
+{
+    ring.release();
+}
+
+void SharedSource::getFrame(byte *buf)
+{
+    // Only asked for when acquireFrame came up empty, so don't wait again
+    const byte *frame = ring.acquire(0);
+    changed = frame != NULL;
+    if (!frame)
+        return;
+    memcpy(buf, frame, frameBytes(format, width, height));
+    ring.release();
+}
+
+bool SharedSource::frameChanged(void) const
+{
+    return changed;
+}
+
+uint64_t SharedSource::getTimestamp(void) const
+{
+    return ring.getTime();
+}
+
+uint16_t SharedSource::getBrightness(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t SharedSource::getHue(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t SharedSource::getColour(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t SharedSource::getContrast(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+uint16_t SharedSource::getWhiteness(void) const
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+
+void SharedSource::setBrightness(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void SharedSource::setHue(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void SharedSource::setColour(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void SharedSource::setContrast(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
+void SharedSource::setWhiteness(uint16_t x)
+{
+    throw UnimplementedError(FUNCTION_HERE);
+}
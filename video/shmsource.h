@@ -0,0 +1,61 @@
+#ifndef SHMSOURCE_H
+#define SHMSOURCE_H
+
+#include <string>
+
+#include "../global.h"
+#include "videodevice.h"
+#include "framering.h"
+
+// Takes frames from a shared memory ring that another process on the same
+// machine writes (see framering.h), so glasses can be a stage in a bigger
+// pipeline without frames going through a fake camera. Frames are lent
+// straight out of the ring, newest first: if glasses falls behind, the ones
+// in between are skipped.
+class SharedSource : public VideoDevice
+{
+    public:
+        /**
+         * @param name  shm:/<ring name>, like shm:/camera
+         * @throw FrameRingError if nothing has made that ring yet
+         */
+        explicit SharedSource(const std::string &name);
+        /** Says how many frames were taken, skipped and overwritten */
+        ~SharedSource(void);
+
+        /** Whether name names a ring (shm:...) */
+        static bool handles(const std::string &name);
+
+        /** Frames come at the size and in the format the writer makes them */
+        void setParams(uint32_t width, uint32_t height, PixelFormat format);
+        void getFrame(byte *buf);
+        const byte* acquireFrame(void);
+        void releaseFrame(void);
+        bool frameChanged(void) const;
+        /** When the writer says the frame was captured */
+        uint64_t getTimestamp(void) const;
+
+        uint16_t getBrightness(void) const;
+        uint16_t getHue(void)        const;
+        uint16_t getColour(void)     const;
+        uint16_t getContrast(void)   const;
+        uint16_t getWhiteness(void)  const;
+
+        void setBrightness(uint16_t);
+        void setHue(uint16_t);
+        void setColour(uint16_t);
+        void setContrast(uint16_t);
+        void setWhiteness(uint16_t);
+
+        // How long to wait for a frame (ms) before carrying on without one
+        static const int32_t patience = 100;
+
+    private:
+        FrameRingReader ring;
+        bool changed;
+
+        explicit SharedSource(const SharedSource& original);
+        SharedSource& operator=(const SharedSource& original);
+};
+
+#endif
@@ -10,13 +10,15 @@ class StaticFile : public VideoDevice
 
         /**
          * Create a StaticFile "device"
-         * @param path  Path to the file. Must be a P6-format PPM sans comments.
+         * @param path  Path to the file. Must be a binary PPM (P6) or PGM (P5).
          */
         explicit StaticFile(const char *path);
         ~StaticFile(void);
 
-        void setParams(uint32_t width, uint32_t height, uint16_t depth, uint16_t palette);
+        void setParams(uint32_t width, uint32_t height, PixelFormat format);
         void getFrame(byte *buf);
+        const byte* acquireFrame(void);
+        bool frameChanged(void) const;
 
         uint16_t getBrightness(void) const;
         uint16_t getHue(void)        const;
@@ -34,6 +36,9 @@ class StaticFile : public VideoDevice
         Pixel *image;
         // Parameters about the image, so we don't blow out of the buffer
         uint32_t image_width, image_height, image_depth;
+        // fresh: the next frame is the first since construction or setParams
+        // changed: the last frame was such a frame
+        bool fresh, changed;
 
         explicit StaticFile(const StaticFile& original);
         StaticFile& operator=(const StaticFile& original);
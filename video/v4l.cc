@@ -1,3 +1,5 @@
+#include <cerrno>
+#include <cstring>
 #include <iostream>
 
 // For open
@@ -5,6 +7,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+// For close and read
+#include <unistd.h>
+
 // For V4l stuff
 #include <linux/types.h>
 #include <linux/videodev.h>
@@ -12,14 +17,33 @@
 // For ioctl
 #include <sys/ioctl.h>
 
+// For mmap capture
+#include <sys/mman.h>
+
 #include "../global.h"
 #include "videodevice.h"
 #include "v4l.h"
+#include "../utils/clock.h"
 
 using namespace std;
 using novas0x2a::Context;
 using novas0x2a::stringify;
 
+namespace
+{
+    // V4L palettes we know the layout of. VIDEO_PALETTE_RGB24 is left out
+    // because drivers store it B,G,R, backwards from FORMAT_RGB24.
+    const struct {uint16_t palette; PixelFormat format;} palettes[] = {
+        {VIDEO_PALETTE_RGB32,   FORMAT_BGRA32},
+        {VIDEO_PALETTE_YUYV,    FORMAT_YUYV},
+        {VIDEO_PALETTE_YUV422,  FORMAT_YUYV},
+        {VIDEO_PALETTE_UYVY,    FORMAT_UYVY},
+        {VIDEO_PALETTE_YUV420P, FORMAT_I420},
+        {VIDEO_PALETTE_GREY,    FORMAT_GRAY8},
+    };
+    const uint32_t palette_count = sizeof(palettes) / sizeof(palettes[0]);
+}
+
 ostream& operator<< (ostream& os, const VideoCapability& a) {
     os  << "Name["        << a.name
         << "] Type["      << a.type
@@ -56,7 +80,7 @@ ostream& operator<< (ostream &os, const V4LDevice& v)
     return os;
 }
 
-V4LDevice::V4LDevice(const char *device) : devname(device)
+V4LDevice::V4LDevice(const char *device) : devname(device), map(NULL), current(0), stamp(0), held(false), no_mmap(false)
 {
     Context c("While creating V4L device");
     if ((dev = open(device, O_RDONLY)) < 0)
@@ -68,6 +92,11 @@ V4LDevice::V4LDevice(const char *device) : devname(device)
         width            = win.width;
         height           = win.height;
         depth            = pic.depth;
+        // Until setParams picks one, hope for the best with anything unknown
+        format           = FORMAT_BGRA32;
+        for (uint32_t i = 0; i < palette_count; ++i)
+            if (palettes[i].palette == pic.palette)
+                format = palettes[i].format;
     } catch (...) { // clean up dev and rethrow
         close(dev);
         throw;
@@ -78,6 +107,7 @@ V4LDevice::V4LDevice(const char *device) : devname(device)
 V4LDevice::~V4LDevice(void)
 {
     Context c("While closing V4L device");
+    this->stopCapture();
     if (close(dev) < 0)
         throw V4LError("Could not close video device");
 }
@@ -133,21 +163,49 @@ void V4LDevice::setPic(const VideoPicture& pic)
     depth = p.depth;
 }
 
-void V4LDevice::setParams(uint32_t width, uint32_t height, uint16_t depth, uint16_t palette)
+void V4LDevice::setParams(uint32_t width, uint32_t height, PixelFormat format)
 {
-    Context c("While setting V4L params (" + stringify(width) + "," + stringify(height) + "@" + stringify(depth) + "bpp)");
+    Context c("While setting V4L params (" + stringify(width) + "," + stringify(height) + " " + formatInfo(format).name + ")");
+    // The queued captures were for the old size; start again on the next acquire
+    this->stopCapture();
+    no_mmap = false;
+
     VideoWindow w = this->getWin();
     w.width  = width;
     w.height = height;
     this->setWin(w);
 
-    if (depth != 0)
+    // The palettes for the format that was asked for first, then anything
+    // else we can convert from. The getPic after each try would clobber
+    // errno, so keep the one from the last refusal for the error.
+    int error = EINVAL;
+    for (uint32_t pass = 0; pass < 2; ++pass)
     {
-        VideoPicture p = this->getPic();
-        p.depth   = depth;
-        p.palette = palette;
-        this->setPic(p);
+        for (uint32_t i = 0; i < palette_count; ++i)
+        {
+            if ((palettes[i].format == format) != (pass == 0))
+                continue;
+            VideoPicture p = this->getPic();
+            p.depth   = formatInfo(palettes[i].format).depth;
+            p.palette = palettes[i].palette;
+            if (ioctl(dev, VIDIOCSPICT, &p) < 0)
+            {
+                error = errno;
+                continue;
+            }
+            // Accepted, but quietly swapped for something else
+            if (this->getPic().palette != p.palette)
+            {
+                error = EINVAL;
+                continue;
+            }
+            this->format = palettes[i].format;
+            this->depth  = p.depth;
+            return;
+        }
     }
+    errno = error;
+    throw V4LError("The device doesn't offer any palette we understand");
 }
 
 uint16_t V4LDevice::getBrightness(void) const
@@ -202,8 +260,101 @@ void V4LDevice::setWhiteness(uint16_t x)
     this->setPic(p);
 }
 
+bool V4LDevice::startCapture(void)
+{
+    Context c("While starting V4L mmap capture");
+    if (ioctl(dev, VIDIOCGMBUF, &mbuf) < 0 || mbuf.frames < 1)
+        return false;
+
+    void *m = mmap(NULL, mbuf.size, PROT_READ, MAP_SHARED, dev, 0);
+    if (m == MAP_FAILED)
+        return false;
+    map = static_cast<byte*>(m);
+
+    try {
+        for (int32_t i = 0; i < mbuf.frames; ++i)
+            this->queueCapture(i);
+    } catch (...) {
+        munmap(map, mbuf.size);
+        map = NULL;
+        throw;
+    }
+    current = 0;
+    held    = false;
+    return true;
+}
+
+void V4LDevice::stopCapture(void)
+{
+    if (!map)
+        return;
+    // Let the driver finish with everything queued before pulling the mapping
+    for (int32_t i = 0; i < mbuf.frames; ++i)
+    {
+        int f = i;
+        if (!(held && uint32_t(i) == current))
+            ioctl(dev, VIDIOCSYNC, &f);
+    }
+    munmap(map, mbuf.size);
+    map  = NULL;
+    held = false;
+}
+
+void V4LDevice::queueCapture(uint32_t frame)
+{
+    struct video_mmap vm;
+    vm.frame  = frame;
+    vm.width  = width;
+    vm.height = height;
+    vm.format = this->getPic().palette;
+    if (ioctl(dev, VIDIOCMCAPTURE, &vm) < 0)
+        throw V4LError("Couldn't queue capture into buffer " + stringify(frame));
+}
+
+const byte* V4LDevice::acquireFrame(void)
+{
+    if (unlikely(!map))
+    {
+        if (no_mmap)
+            return NULL;
+        if (!this->startCapture())
+        {
+            no_mmap = true;
+            return NULL;
+        }
+    }
+
+    int f = current;
+    if (ioctl(dev, VIDIOCSYNC, &f) < 0)
+        throw V4LError("Couldn't wait for capture buffer " + stringify(current));
+    // V4L1 buffers carry no time, but the sync returns as the capture ends
+    stamp = novas0x2a::monotonic_ns();
+    held = true;
+    return map + mbuf.offsets[current];
+}
+
+void V4LDevice::releaseFrame(void)
+{
+    held = false;
+    this->queueCapture(current);
+    current = (current + 1) % mbuf.frames;
+}
+
+uint64_t V4LDevice::getTimestamp(void) const
+{
+    return stamp;
+}
+
 void V4LDevice::getFrame(byte *buf)
 {
-    if (read(dev, buf, width * height * depth>>3) < 0)
+    // Reads and mmap capture don't mix, so once streaming, copy out of that
+    if (map)
+    {
+        memcpy(buf, this->acquireFrame(), frameBytes(format, width, height));
+        this->releaseFrame();
+        return;
+    }
+    if (read(dev, buf, frameBytes(format, width, height)) < 0)
         throw V4LError("Unable to read from device");
+    stamp = novas0x2a::monotonic_ns();
 }
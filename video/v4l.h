@@ -29,8 +29,11 @@ class V4LDevice : public VideoDevice
 
         friend std::ostream& operator<< (std::ostream &os, const V4LDevice& v);
 
-        void setParams(uint32_t width, uint32_t height, uint16_t depth, uint16_t palette);
+        void setParams(uint32_t width, uint32_t height, PixelFormat format);
         void getFrame(byte *buf);
+        const byte* acquireFrame(void);
+        void releaseFrame(void);
+        uint64_t getTimestamp(void) const;
 
         uint16_t getBrightness(void) const;
         uint16_t getHue(void) const;
@@ -52,12 +55,29 @@ class V4LDevice : public VideoDevice
         void setWin(const VideoWindow&);
         void setPic(const VideoPicture&);
 
+        /**
+         * Map the driver's capture buffers and queue a capture into each.
+         * @return false if the driver doesn't do mmap capture
+         */
+        bool startCapture(void);
+        void stopCapture(void);
+        void queueCapture(uint32_t frame);
+
     private:
         explicit V4LDevice(const V4LDevice& original);
         V4LDevice& operator=(const V4LDevice& original);
 
         const std::string devname;
         int dev;
+
+        // mmap capture. Each buffer is either queued with the driver or (the
+        // current one, between acquire and release) held by us.
+        struct video_mbuf mbuf;
+        byte *map;
+        uint32_t current;
+        // When the last frame finished capturing
+        uint64_t stamp;
+        bool held, no_mmap;
 };
 
 class V4LError : public VideoError
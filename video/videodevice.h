@@ -3,6 +3,7 @@
 
 #include "../utils/context.h"
 #include "../global.h"
+#include "format.h"
 
 class VideoDevice
 {
@@ -12,21 +13,50 @@ class VideoDevice
         virtual ~VideoDevice(void) {};
 
         /**
-         * Configure the device
+         * Configure the device. Devices that can't scale (files, most
+         * recordings) keep their own size, so check getWidth and getHeight
+         * afterwards.
          * @param width     width in pixels
          * @param height    height in pixels
-         * @param depth     depth in bpp
-         * @param palette   pixel storage format (ie, RGB? BGR? etc)
+         * @param format    pixel format to deliver frames in. Devices that
+         *                  can't do it pick the nearest they can; check
+         *                  getFormat afterwards.
          */
-        virtual void setParams(uint32_t width, uint32_t height, uint16_t depth, uint16_t palette) = 0;
+        virtual void setParams(uint32_t width, uint32_t height, PixelFormat format) = 0;
 
         /**
          * Get a frame from the device
-         * @param buf   A buffer to copy the frame into. Needs to
-         *              be width*height*depth>>3 bytes large
+         * @param buf   A buffer to copy the frame into. Needs to be
+         *              frameBytes(getFormat(), width, height) bytes large
          */
         virtual void getFrame(byte *buf) = 0;
 
+        /**
+         * Borrow the next frame from the device's own buffer rather than
+         * copying it. The frame is laid out as for getFrame and stays
+         * valid (and unchanged) until releaseFrame. Don't call getFrame,
+         * setParams or acquireFrame again before releasing it.
+         * @return  The frame, or NULL if the device can't lend one right now
+         *          (use getFrame instead)
+         */
+        virtual const byte* acquireFrame(void) {return NULL;};
+
+        /** Give back the frame from the last acquireFrame that returned one */
+        virtual void releaseFrame(void) {};
+
+        /**
+         * Whether the last frame from getFrame differs from the one before.
+         * Sources that can't tell should say it did.
+         */
+        virtual bool frameChanged(void) const {return true;};
+
+        /**
+         * When the last frame from getFrame or acquireFrame was captured,
+         * in monotonic_ns. Sources that can't tell say 0, and the frame
+         * counts as captured when it was taken.
+         */
+        virtual uint64_t getTimestamp(void) const {return 0;};
+
         // Getters and setters for various video parameters
         virtual uint16_t getBrightness(void) const = 0;
         virtual uint16_t getHue(void)        const = 0;
@@ -43,9 +73,12 @@ class VideoDevice
         inline uint32_t getWidth(void)  const {return width;};
         inline uint32_t getHeight(void) const {return height;};
         inline uint32_t getDepth(void)  const {return depth;};
+        inline PixelFormat getFormat(void) const {return format;};
 
     protected:
+        // depth is formatInfo(format).depth
         uint32_t width, height, depth;
+        PixelFormat format;
 
     private:
         // Do not allow copying or assignment
@@ -2,13 +2,12 @@
 #include <string>
 #include <cmath>
 #include <cerrno>
+#include <cstring>
 #include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
 
-// For open
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <sys/time.h>
 #include <time.h>
 
 // For SDL
@@ -18,33 +17,119 @@
 #include "global.h"
 #include "window.h"
 #include "utils/average.h"
+#include "utils/clock.h"
+#include "video/convert.h"
 
 using namespace std;
 using namespace novas0x2a;
 
-inline SDL_Surface* makeFrame(VideoDevice &v)
+namespace
+{
+    // Filters with equal keys compute the same frame
+    struct FilterKey
+    {
+        FilterKey(const Filter &f, uint32_t src) : f(f.f), configured(f.configured), src(src), flags(f.flags), params(&f.params) {};
+        bool operator< (const FilterKey &o) const
+        {
+            if (f != o.f)
+                return std::less<FilterFunc>()(f, o.f);
+            if (configured != o.configured)
+                return std::less<ConfigFilterFunc>()(configured, o.configured);
+            if (src != o.src)
+                return src < o.src;
+            if (flags != o.flags)
+                return flags < o.flags;
+            return *params < *o.params;
+        }
+        FilterFunc f;
+        ConfigFilterFunc configured;
+        uint32_t src, flags;
+        const FilterParams *params;
+    };
+}
+
+namespace
+{
+    // How long to leave a source that had nothing new when nothing else
+    // paces the main loop, before asking it again
+    const uint64_t idle_ns = 5000000;
+
+    // Clocks can disagree a little between processes, so a frame is never
+    // from the future
+    inline uint64_t elapsed(uint64_t from, uint64_t to)
+    {
+        return to > from ? to - from : 0;
+    }
+
+    // Whether a slot's filter can go to the task pool. The rest only mark
+    // what changed, or keep state that isn't safe to share between threads.
+    inline bool poolable(const Filter &f, uint32_t idx)
+    {
+        return idx != 0 && !f.empty() && f.alias == idx && !(f.flags & FILTER_SERIAL);
+    }
+
+    inline bool yuv(PixelFormat f)
+    {
+        return f == FORMAT_YUYV || f == FORMAT_UYVY || f == FORMAT_NV12 || f == FORMAT_I420;
+    }
+}
+
+inline SDL_Surface* makeFrame(uint32_t w, uint32_t h, PixelFormat format)
 {
     Context c("When making framebuffer");
-    void *px = new byte[v.getWidth() * v.getHeight() * (v.getDepth()>>3)];
-    return SDL_CreateRGBSurfaceFrom(px, v.getWidth(), v.getHeight(), v.getDepth(), v.getWidth()*(v.getDepth()>>3), 0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+    if (format == FORMAT_BGRA32)
+        return SDL_CreateRGBSurfaceFrom(new byte[w * h * sizeof(Pixel)], w, h, 32, w*sizeof(Pixel), 0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+
+    // Gray goes up through a palette, and the blit expands it
+    SDL_Surface *s = SDL_CreateRGBSurfaceFrom(new byte[w * h], w, h, 8, w, 0, 0, 0, 0);
+    SDL_Color ramp[256];
+    for (uint32_t i = 0; i < 256; ++i)
+        ramp[i].r = ramp[i].g = ramp[i].b = i;
+    SDL_SetColors(s, ramp, 0, 256);
+    return s;
 }
 
-Window::Window(VideoDevice &_v, uint32_t _windows) : v(_v), windows(_windows+1)
+Window::Window(VideoDevice &_v, uint32_t _windows, uint32_t _width, uint32_t _height, uint32_t _tile_w, uint32_t _tile_h, ResampleMethod method) :
+    v(_v), windows(_windows+1), reschedule(true), display(60), times(), pool(TaskPool::get()), record_path("rec.y4m"), record_slot(-1), record_fps(30),
+    graph(NULL), plugins(NULL), graph_checked(0)
 {
+    fps_rect = (SDL_Rect){0,0,0,0};
     Context c("When constructing Main Window");
-    if (v.getDepth() != 32) // TODO: Not pixel-format generic
-        throw ArgumentError("Only 3-byte color with 4-byte pixels is supported");
 
     winside = ceil(sqrt(windows));
 
+    width  = _width  ? _width  : v.getWidth();
+    height = _height ? _height : v.getHeight();
+    tile_w = _tile_w ? _tile_w : width;
+    tile_h = _tile_h ? _tile_h : height;
+    if (width != v.getWidth() || height != v.getHeight())
+    {
+        scaler.reset(new Resampler(v.getWidth(), v.getHeight(), width, height, method));
+        // Chroma is halved across (and down, for 4:2:0), and is scaled to a
+        // sample per pixel so none of its detail is lost
+        if (yuv(v.getFormat()))
+        {
+            const uint32_t ch = formatInfo(v.getFormat()).planar ? (v.getHeight() + 1) / 2 : v.getHeight();
+            chroma.reset(new Resampler((v.getWidth() + 1) / 2, ch, width, height, method));
+        }
+    }
+    // Previews are redone every time a tile changes, so they get the cheap filter
+    if (tile_w != width || tile_h != height)
+        previewer.reset(new Resampler(width, height, tile_w, tile_h, RESAMPLE_BILINEAR));
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         throw GeneralError(DEBUG_HERE, "Could not init SDL");
 
     SDL_WM_SetCaption(PROGRAM "-" VERSION, PROGRAM);
 
-    if (!(screen = SDL_SetVideoMode(v.getWidth()*winside, v.getHeight()*winside, v.getDepth(), SDL_HWSURFACE)))
+    if (!(screen = SDL_SetVideoMode(tile_w*winside, tile_h*winside, 32, SDL_HWSURFACE)))
         throw SDLError("Unable to set video mode");
 
+    // Tiles are only redrawn when they change, so start from a blank screen
+    if (SDL_FillRect(screen, NULL, 0) != 0)
+        throw SDLError("FillRect failed");
+    damage.add(Rect(0, 0, screen->w, screen->h));
+
     if (TTF_Init() == -1)
         throw TTFError("Could not init TTF");
 
@@ -52,45 +137,939 @@ Window::Window(VideoDevice &_v, uint32_t _windows) : v(_v), windows(_windows+1)
         throw TTFError("Could not load font");
 
     for (uint16_t i = 0; i < windows; ++i)
-        funcs.push_back(Filter(0, NULL, string(i == 0 ? "source" : "None"), -1));
-    funcs[0].frame = makeFrame(v);
+    {
+        funcs.push_back(Filter(0, string(i == 0 ? "source" : "None"), -1));
+        funcs.back().alias = i;
+    }
+    Allocate(funcs[0], FORMAT_BGRA32);
+    published.resize(windows, false);
+    rings.resize(windows, NULL);
+    upscalers.resize(windows, NULL);
+    detectors.resize(windows, NULL);
+    tasks.resize(windows);
+    for (uint32_t i = 0; i < windows; ++i)
+    {
+        tasks[i].w   = this;
+        tasks[i].idx = i;
+    }
 }
 
 Window::~Window(void)
 {
     Context c("When Destructing Main Window");
+    if (recorder.get())
+        ToggleRecording();
+    if (to_grabbed.getCount())
+        ReportStats(cerr);
+    for (vector<FrameRingWriter*>::iterator r = rings.begin(); r != rings.end(); ++r)
+        delete *r;
+    for (vector<Resampler*>::iterator u = upscalers.begin(); u != upscalers.end(); ++u)
+        delete *u;
+    for (vector<MotionDetector*>::iterator d = detectors.begin(); d != detectors.end(); ++d)
+        delete *d;
     TTF_CloseFont(font);
     vector<Filter>::iterator i;
     for (i = funcs.begin(); i != funcs.end(); ++i)
-    {
-        if (i->frame)
-        {
-            delete [] static_cast<byte*>(i->frame->pixels);
-            SDL_FreeSurface(i->frame);
-        }
-    }
+        FreeFrame(*i);
     SDL_FreeSurface(screen);
     SDL_Quit();
 }
 
-void Window::DrawText(const char *text, SDL_Rect loc, SDL_Color fg, SDL_Color bg)
+SDL_Rect Window::DrawText(const char *text, SDL_Rect loc, SDL_Color fg, SDL_Color bg)
 {
     SDL_Surface *txt = TTF_RenderText_Shaded(font, text, fg, bg);
     if (SDL_BlitSurface(txt, NULL, screen, &loc) != 0)
         throw SDLError("Text Blit failed: ");
     SDL_FreeSurface(txt);
+    Damage(loc);
+    return loc;
+}
+
+void Window::Schedule(void)
+{
+    Context c("When scheduling filters");
+    vector<byte> state(funcs.size(), 0);
+    vector<uint32_t>::const_iterator i;
+    order.clear();
+
+    for (uint32_t idx = 0; idx < funcs.size(); ++idx)
+        if ((funcs[idx].output || published[idx]) && funcs[idx].frame)
+            Visit(idx, state);
+
+    for (uint32_t idx = 0; idx < funcs.size(); ++idx)
+    {
+        Filter &f = funcs[idx];
+        // Anything that sat out missed frames, so treat it as new
+        if (state[idx] && !f.needed)
+            f.stale = true;
+        f.needed = state[idx];
+    }
+
+    // Sources come first in the order, so their formats are settled by the
+    // time their readers choose
+    ChooseSource();
+    for (i = order.begin(); i != order.end(); ++i)
+        if (*i != 0 && !funcs[*i].empty())
+            Choose(*i);
+
+    // Common subexpressions: a filter that does the same thing, with the same
+    // parameters, to the same (possibly shared) source as one earlier in the
+    // order just shows its frame.
+    // Volatile filters have side effects, so each of them runs.
+    map<FilterKey, uint32_t> seen;
+    for (i = order.begin(); i != order.end(); ++i)
+    {
+        Filter &f = funcs[*i];
+        if (*i == 0 || f.empty() || (f.flags & FILTER_VOLATILE))
+        {
+            Unshare(*i);
+            continue;
+        }
+
+        FilterKey key(f, funcs[f.src].alias);
+        map<FilterKey, uint32_t>::const_iterator first = seen.find(key);
+        if (first == seen.end())
+        {
+            Unshare(*i);
+            seen.insert(make_pair(key, *i));
+        }
+        else
+            Share(*i, first->second);
+    }
+    ChooseDirect();
+    Prioritize();
+    Stage();
+    reschedule = false;
+}
+
+void Window::ChooseDirect(void)
+{
+    // Rows of a tile have to be rows of the frame, with the pixels laid out
+    // the same way
+    const SDL_PixelFormat *fmt = screen->format;
+    const bool possible = !previewer.get() && fmt->BytesPerPixel == 4 &&
+        fmt->Rmask == 0x00ff0000 && fmt->Gmask == 0x0000ff00 && fmt->Bmask == 0x000000ff;
+
+    // Anything another filter reads or shows has to stay in pixels
+    vector<bool> read(funcs.size(), false);
+    for (uint32_t idx = 1; idx < funcs.size(); ++idx)
+    {
+        if (funcs[idx].empty())
+            continue;
+        read[funcs[idx].src] = true;
+        if (funcs[idx].alias != idx)
+            read[funcs[idx].alias] = true;
+    }
+
+    for (uint32_t idx = 1; idx < funcs.size(); ++idx)
+    {
+        Filter &f = funcs[idx];
+        const bool direct = possible && !f.empty() && f.needed && f.output && !read[idx] && f.alias == idx &&
+            (f.flags & FILTER_POINTWISE) && f.format == FORMAT_BGRA32 &&
+            !published[idx] && int32_t(idx) != record_slot;
+        // Switching either way leaves what's now used (the tile or pixels)
+        // behind, so it's redone in full
+        if (direct != f.direct)
+            f.stale = true;
+        f.direct = direct;
+    }
+}
+
+void Window::Prioritize(void)
+{
+    // Consumers come after their sources in the order, so going backwards
+    // hands each slot's priority down to everything it reads
+    vector<Priority> prio(funcs.size(), PRIORITY_LOW);
+    vector<uint32_t>::reverse_iterator i;
+    for (i = order.rbegin(); i != order.rend(); ++i)
+    {
+        const Filter &f = funcs[*i];
+        if (*i == 0 || f.empty())
+            continue;
+        prio[*i] = max(prio[*i], f.priority);
+        prio[f.src] = max(prio[f.src], prio[*i]);
+        prio[f.alias] = max(prio[f.alias], prio[*i]);
+    }
+
+    qos.clear();
+    for (i = order.rbegin(); i != order.rend(); ++i)
+    {
+        const Filter &f = funcs[*i];
+        if (*i == 0 || f.empty() || f.alias != *i)
+            continue;
+        // A half-size run reads the source's pyramid as it is, and is
+        // scaled back up into pixels
+        const PixelFormat src = funcs[f.src].format;
+        const bool proxy = (f.flags & FILTER_SCALABLE) && !f.direct && src == f.in &&
+            (src == FORMAT_BGRA32 || src == FORMAT_GRAY8) &&
+            (f.format == FORMAT_BGRA32 || f.format == FORMAT_GRAY8) &&
+            width >= 4 && height >= 4;
+        qos.setSlot(*i, f.name, prio[*i], proxy);
+    }
+}
+
+void Window::Stage(void)
+{
+    // Where each slot is in the order, and which wave it's in
+    vector<uint32_t> pos(funcs.size(), 0), wave(funcs.size(), 0);
+    for (uint32_t k = 0; k < order.size(); ++k)
+        pos[order[k]] = k;
+
+    // A slot reads its source's frame and dirty area, and the pixels and
+    // pyramid of whichever filter computed it (the source's alias); a shared
+    // slot reads its alias's dirty area
+    vector<vector<uint32_t> > reads(funcs.size());
+    vector<uint32_t>::const_iterator i, r;
+    for (i = order.begin(); i != order.end(); ++i)
+    {
+        const Filter &f = funcs[*i];
+        if (*i == 0 || f.empty())
+            continue;
+        reads[*i].push_back(f.src);
+        reads[*i].push_back(funcs[f.src].alias);
+        if (f.alias != *i)
+            reads[*i].push_back(f.alias);
+    }
+
+    // Goes by the order, so a slot's wave comes after those of whatever it
+    // reads this frame. A loop reads last frame's output, so whatever closes
+    // it has to wait until the slots reading it are done.
+    uint32_t last = 0;
+    for (uint32_t k = 0; k < order.size(); ++k)
+    {
+        const uint32_t idx = order[k];
+        uint32_t w = 0;
+        for (r = reads[idx].begin(); r != reads[idx].end(); ++r)
+            if (pos[*r] < k)
+                w = max(w, wave[*r] + 1);
+        for (uint32_t j = 0; j < k; ++j)
+            if (find(reads[order[j]].begin(), reads[order[j]].end(), idx) != reads[order[j]].end())
+                w = max(w, wave[order[j]] + 1);
+        wave[idx] = w;
+        last = max(last, w);
+    }
+
+    waves.assign(order.empty() ? 0 : last + 1, vector<uint32_t>());
+    for (i = order.begin(); i != order.end(); ++i)
+        waves[wave[*i]].push_back(*i);
+}
+
+void Window::Share(uint32_t idx, uint32_t canon)
+{
+    Filter &f = funcs[idx];
+    if (f.alias == canon)
+        return;
+    delete [] f.buffer;
+    f.buffer = NULL;
+    SetPixels(f, funcs[canon].pixels);
+    f.alias = canon;
+    // The tile needs redrawing with the shared pixels
+    f.stale = true;
+}
+
+void Window::Unshare(uint32_t idx)
+{
+    Filter &f = funcs[idx];
+    if (f.alias == idx)
+        return;
+    if (f.frame)
+    {
+        const size_t size = frameBytes(f.format, width, height);
+        f.buffer = new byte[size];
+        memcpy(f.buffer, funcs[f.alias].pixels, size);
+        SetPixels(f, f.buffer);
+    }
+    f.alias = idx;
+}
+
+namespace
+{
+    // Taking the input as it comes beats converting it; after that, the
+    // fewer bytes there are to read and write, the better
+    bool better(const Kernel &a, const Kernel &b, PixelFormat have)
+    {
+        if ((a.in == have) != (b.in == have))
+            return a.in == have;
+        if (a.in != have && formatInfo(a.in).depth != formatInfo(b.in).depth)
+            return formatInfo(a.in).depth < formatInfo(b.in).depth;
+        return formatInfo(a.out).depth < formatInfo(b.out).depth;
+    }
+
+    // Whether f still runs info's function (plugins get reloaded)
+    inline bool placed(const FilterInfo &info, const Filter &f)
+    {
+        return info.f == f.f && info.configured == f.configured;
+    }
+
+    // Whether f is the registered filter by its name, with a kernel for gray
+    bool takesGray(const Filter &f)
+    {
+        if (!FilterRegistry::get().has(f.name))
+            return false;
+        const FilterInfo &info = FilterRegistry::get().find(f.name);
+        if (!placed(info, f))
+            return false;
+        vector<Kernel>::const_iterator k;
+        for (k = info.kernels.begin(); k != info.kernels.end(); ++k)
+            if (k->in == FORMAT_GRAY8)
+                return true;
+        return false;
+    }
+}
+
+void Window::ChooseSource(void)
+{
+    // Gray saves nothing on a BGRA frame, which can be lent as it is. Gray
+    // is all there is to a gray device's frame, but anything else's colour
+    // is lost to whatever shows, publishes or records slot 0.
+    const PixelFormat from = v.getFormat();
+    bool gray = from != FORMAT_BGRA32;
+    if (from != FORMAT_GRAY8 && from != FORMAT_GRAY16)
+        gray = gray && !funcs[0].output && !published[0] && record_slot != 0;
+
+    bool read = false;
+    for (uint32_t idx = 1; gray && idx < funcs.size(); ++idx)
+    {
+        const Filter &f = funcs[idx];
+        if (f.empty() || !f.needed || f.src != 0)
+            continue;
+        read = true;
+        gray = takesGray(f);
+    }
+    Reformat(0, gray && read ? FORMAT_GRAY8 : FORMAT_BGRA32);
+}
+
+void Window::Choose(uint32_t idx)
+{
+    Filter &f = funcs[idx];
+    const PixelFormat have = funcs[f.src].format;
+
+    // f itself is always an option. The other kernels only belong to it if
+    // it's the registered filter by that name.
+    Kernel best(FORMAT_BGRA32, FORMAT_BGRA32, NULL);
+    RowsFunc rows = NULL;
+    uint32_t halo = 0;
+    if (FilterRegistry::get().has(f.name))
+    {
+        const FilterInfo &info = FilterRegistry::get().find(f.name);
+        vector<Kernel>::const_iterator k;
+        if (placed(info, f))
+        {
+            rows = info.rows;
+            halo = info.halo;
+            for (k = info.kernels.begin(); k != info.kernels.end(); ++k)
+                if (canConvert(have, k->in) && better(*k, best, have))
+                    best = *k;
+        }
+    }
+
+    f.kernel      = best.f;
+    f.kernel_rows = best.rows;
+    f.rows        = best.f ? NULL : rows;
+    // Point-wise filters read nothing beyond their band
+    f.halo        = (f.flags & FILTER_POINTWISE) ? 0 : halo;
+    f.in          = best.in;
+    Reformat(idx, best.out);
+}
+
+void Window::Reformat(uint32_t idx, PixelFormat format)
+{
+    Filter &f = funcs[idx];
+    if (f.format == format)
+        return;
+    for (uint32_t i = 0; i < funcs.size(); ++i)
+        if (i != idx && funcs[i].alias == idx)
+            Unshare(i);
+    FreeFrame(f);
+    Allocate(f, format);
+    f.alias = idx;
+    f.stale = true;
+}
+
+void Window::Allocate(Filter &f, PixelFormat format)
+{
+    f.format = format;
+    f.frame  = makeFrame(width, height, format);
+    if (format == FORMAT_GRAY16)
+        f.buffer = new byte[frameBytes(format, width, height)];
+    else
+        f.buffer = static_cast<byte*>(f.frame->pixels);
+    f.pixels = f.buffer;
+}
+
+void Window::FreeFrame(Filter &f)
+{
+    if (!f.frame)
+        return;
+    if (f.preview)
+    {
+        delete [] static_cast<byte*>(f.preview->pixels);
+        SDL_FreeSurface(f.preview);
+        f.preview = NULL;
+    }
+    if (f.format == FORMAT_GRAY16)
+        delete [] static_cast<byte*>(f.frame->pixels);
+    delete [] f.buffer;
+    SDL_FreeSurface(f.frame);
+    f.frame  = NULL;
+    f.buffer = f.pixels = NULL;
+}
+
+void Window::SetPixels(Filter &f, byte *pixels)
+{
+    f.pixels = pixels;
+    if (f.format != FORMAT_GRAY16)
+        f.frame->pixels = pixels;
+}
+
+namespace
+{
+    inline void run(const Filter &f, const byte *in, byte *out, uint32_t width, uint32_t rows)
+    {
+        if (f.kernel)
+            f.kernel(in, out, width, rows);
+        else if (f.configured)
+            f.configured(f.config.empty() ? NULL : &f.config[0], reinterpret_cast<const Pixel*>(in), reinterpret_cast<Pixel*>(out), width, rows);
+        else
+            f.f(reinterpret_cast<const Pixel*>(in), reinterpret_cast<Pixel*>(out), width, rows);
+    }
+
+    // Whether the filter can be run a band of rows at a time
+    inline bool banded(const Filter &f)
+    {
+        return (f.flags & FILTER_POINTWISE) || (f.kernel ? f.kernel_rows != NULL : f.rows != NULL);
+    }
+
+    // Bands smaller than this many pixels cost more to hand out than
+    // running them elsewhere saves
+    const uint64_t band_pixels = 1 << 15;
+}
+
+void Window::Apply(Filter &f, uint32_t y, uint32_t rows)
+{
+    const Filter &s = funcs[f.src];
+
+    const uint32_t idx = &f - &funcs[0];
+    if (unlikely(qos.proxied(idx)))
+    {
+        // Cut back to half size. The source's pyramid already has the input
+        // at that size, in the filter's format (see Prioritize).
+        Pyramid &p = funcs[s.alias].pyramid;
+        const uint32_t w = p.getWidth(1), h = p.getHeight(1);
+        const byte *small = p.level(1);
+        Pyramid mine;
+        mine.reset(small, p.getFormat(), w, h);
+        f.proxy.resize(frameBytes(f.format, w, h));
+        set_input_pyramid(&mine);
+        set_slot_motion(&detectors[idx]);
+        run(f, small, &f.proxy[0], w, h);
+        set_input_pyramid(NULL);
+        set_slot_motion(NULL);
+
+        Resampler *&upscaler = upscalers[idx];
+        if (!upscaler || upscaler->getInWidth() != w || upscaler->getInHeight() != h)
+        {
+            delete upscaler;
+            upscaler = NULL;
+            upscaler = new Resampler(w, h, width, height, RESAMPLE_BILINEAR);
+        }
+        if (f.format == FORMAT_BGRA32)
+            upscaler->run(reinterpret_cast<const Pixel*>(&f.proxy[0]), reinterpret_cast<Pixel*>(f.pixels));
+        else
+            upscaler->run(&f.proxy[0], f.pixels);
+        return;
+    }
+
+    if (s.format != f.in)
+        f.input.resize(frameBytes(f.in, width, height));
+
+    // A stencil reads its input around each row, so the rows whose input
+    // changed change the rows its halo reaches from them too
+    const uint32_t y0 = y > f.halo ? y - f.halo : 0, y1 = min(height, y + rows + f.halo);
+    const uint32_t bands = Bands(f, y1 - y0);
+    if (bands < 2)
+    {
+        Convert(f, y, y + rows);
+        RunRows(f, y0, y1);
+        return;
+    }
+
+    // Each band converts its own rows first, unless the filter reads
+    // beyond its band, when the whole input has to be ready before any of
+    // them runs
+    vector<BandTask> jobs(bands);
+    TaskGroup group(pool);
+    const bool first = f.halo && s.format != f.in;
+    for (uint32_t b = 0; b < bands; ++b)
+    {
+        BandTask &t = jobs[b];
+        t.w = this;
+        t.f = &f;
+        t.run0 = y0 + uint64_t(y1 - y0) * b / bands;
+        t.run1 = y0 + uint64_t(y1 - y0) * (b + 1) / bands;
+        if (first)
+        {
+            t.convert0 = y + uint64_t(rows) * b / bands;
+            t.convert1 = y + uint64_t(rows) * (b + 1) / bands;
+            t.run1 = t.run0;
+        }
+        else
+        {
+            t.convert0 = t.run0;
+            t.convert1 = t.run1;
+        }
+        group.spawn(&t);
+    }
+    group.wait();
+    if (!first)
+        return;
+
+    for (uint32_t b = 0; b < bands; ++b)
+    {
+        BandTask &t = jobs[b];
+        t.convert1 = t.convert0;
+        t.run1 = y0 + uint64_t(y1 - y0) * (b + 1) / bands;
+        group.spawn(&t);
+    }
+    group.wait();
+}
+
+uint32_t Window::Bands(const Filter &f, uint32_t rows) const
+{
+    if (!banded(f) || pool.getThreads() < 2)
+        return 1;
+    // Enough to keep every thread busy, with some left over for whoever
+    // finishes first to take
+    const uint64_t most = uint64_t(width) * rows / band_pixels;
+    return max<uint64_t>(1, min<uint64_t>(min<uint64_t>(most, pool.getThreads() * 4), rows));
+}
+
+void Window::Convert(Filter &f, uint32_t y0, uint32_t y1)
+{
+    const Filter &s = funcs[f.src];
+    if (s.format == f.in || y0 >= y1)
+        return;
+    // Slots only hold packed formats, so rows convert on their own
+    const size_t src_row = size_t(width) * formatInfo(s.format).depth / 8;
+    const size_t in_row  = size_t(width) * formatInfo(f.in).depth / 8;
+    convertFrame(s.format, s.pixels + y0*src_row, f.in, &f.input[y0*in_row], width, y1 - y0);
+}
+
+void Window::RunRows(Filter &f, uint32_t y0, uint32_t y1)
+{
+    if (y0 >= y1)
+        return;
+    const Filter &s = funcs[f.src];
+    const size_t in_row  = size_t(width) * formatInfo(f.in).depth / 8;
+    const size_t out_row = size_t(width) * formatInfo(f.format).depth / 8;
+    const byte *in = s.format != f.in ? &f.input[0] : s.pixels;
+
+    // Whichever filter computed the source frame holds its pyramid
+    set_input_pyramid(&funcs[s.alias].pyramid);
+    set_slot_motion(&detectors[&f - &funcs[0]]);
+    if (f.direct)
+    {
+        // Point-wise, so it can go a row at a time, each straight into its
+        // row of the tile
+        const Rect t = Tile(&f - &funcs[0]);
+        byte *out = static_cast<byte*>(screen->pixels) + (t.y + y0) * screen->pitch + t.x * sizeof(Pixel);
+        for (uint32_t r = y0; r < y1; ++r, out += screen->pitch)
+            run(f, in + r*in_row, out, width, 1);
+    }
+    else if (f.kernel_rows)
+        f.kernel_rows(in, f.pixels, width, height, y0, y1);
+    else if (f.rows)
+        f.rows(reinterpret_cast<const Pixel*>(in), reinterpret_cast<Pixel*>(f.pixels), width, height, y0, y1);
+    else
+        run(f, in + y0*in_row, f.pixels + y0*out_row, width, y1 - y0);
+    set_input_pyramid(NULL);
+    set_slot_motion(NULL);
+}
+
+// Depth-first, so a filter lands in the order after its source. A filter
+// that is already being visited closes a loop; it reads last frame's output.
+void Window::Visit(uint32_t idx, vector<byte> &state)
+{
+    if (state[idx])
+        return;
+    state[idx] = 1;
+    if (idx != 0)
+        Visit(funcs[idx].src, state);
+    order.push_back(idx);
+}
+
+const byte* Window::GrabSource(void)
+{
+    Filter &f = funcs[0];
+    const byte *lent = v.acquireFrame();
+
+    // Slot 0's format has to be settled before anything goes in it
+    if (unlikely(reschedule))
+        Schedule();
+
+    // Point slot 0 straight at the source's buffer if it will lend it,
+    // and only copy when it won't
+    if (likely(v.getFormat() == f.format && !scaler.get()))
+    {
+        if (lent)
+            SetPixels(f, const_cast<byte*>(lent));
+        else
+        {
+            SetPixels(f, f.buffer);
+            v.getFrame(f.buffer);
+        }
+        return lent;
+    }
+
+    SetPixels(f, f.buffer);
+    if (!lent)
+    {
+        raw.resize(frameBytes(v.getFormat(), v.getWidth(), v.getHeight()));
+        v.getFrame(&raw[0]);
+    }
+    // Nothing to convert for if every output is off the source's path
+    if (f.needed && (v.frameChanged() || f.stale))
+    {
+        const byte *frame = lent ? lent : &raw[0];
+        if (!scaler.get())
+            convertFrame(v.getFormat(), frame, f.format, f.buffer, width, height);
+        else
+            ScaleSource(frame);
+    }
+    // Slot 0 has its own copy now, so the device can have its buffer back
+    if (lent)
+        v.releaseFrame();
+    return NULL;
+}
+
+void Window::ScaleSource(const byte *frame)
+{
+    Filter &f = funcs[0];
+    const PixelFormat from = v.getFormat();
+    const uint32_t w = v.getWidth(), h = v.getHeight();
+
+    // Gray has the one plane to scale, and is the cheapest thing to make at
+    // the full size
+    if (f.format == FORMAT_GRAY8 || from == FORMAT_GRAY8 || from == FORMAT_GRAY16)
+    {
+        if (from != FORMAT_GRAY8)
+        {
+            native.resize(frameBytes(FORMAT_GRAY8, w, h));
+            convertFrame(from, frame, FORMAT_GRAY8, &native[0], w, h);
+            frame = &native[0];
+        }
+        if (f.format == FORMAT_GRAY8)
+            scaler->run(frame, f.buffer);
+        else
+        {
+            scaled.resize(frameBytes(FORMAT_GRAY8, width, height));
+            scaler->run(frame, &scaled[0]);
+            convertFrame(FORMAT_GRAY8, &scaled[0], FORMAT_BGRA32, f.buffer, width, height);
+        }
+        return;
+    }
+
+    if (!chroma.get())
+    {
+        // The scaler works on whole pixels, so RGB has to be unpacked first
+        if (from != FORMAT_BGRA32)
+        {
+            native.resize(frameBytes(FORMAT_BGRA32, w, h));
+            convertFrame(from, frame, FORMAT_BGRA32, &native[0], w, h);
+            frame = &native[0];
+        }
+        scaler->run(reinterpret_cast<const Pixel*>(frame), reinterpret_cast<Pixel*>(f.buffer));
+        return;
+    }
+
+    // YUV is split into planes (unless it's I420 already), and each plane is
+    // scaled to the processing size before anything is unpacked to BGRA
+    const uint32_t cw = chroma->getInWidth();
+    const size_t luma = size_t(w) * h, plane = size_t(cw) * chroma->getInHeight();
+    const byte *y = frame, *cb = frame + luma, *cr = cb + plane;
+    if (from != FORMAT_I420)
+    {
+        native.resize(from == FORMAT_NV12 ? 2*plane : luma + 2*plane);
+        byte *u = &native[native.size() - 2*plane];
+        if (from == FORMAT_NV12)
+            split_uv(frame + luma, u, u + plane, plane);
+        else
+        {
+            const size_t row = size_t(cw) * 4;
+            for (uint32_t r = 0; r < h; ++r)
+                if (from == FORMAT_YUYV)
+                    yuyv_to_planes(frame + r*row, &native[r*w], u + r*cw, u + plane + r*cw, w);
+                else
+                    uyvy_to_planes(frame + r*row, &native[r*w], u + r*cw, u + plane + r*cw, w);
+            y = &native[0];
+        }
+        cb = u;
+        cr = u + plane;
+    }
+
+    const size_t out = size_t(width) * height;
+    scaled.resize(3 * out);
+    scaler->run(y, &scaled[0]);
+    chroma->run(cb, &scaled[out]);
+    chroma->run(cr, &scaled[2 * out]);
+    yuv444_to_bgra(&scaled[0], &scaled[out], &scaled[2 * out], reinterpret_cast<Pixel*>(f.buffer), out);
+}
+
+void Window::RunFilters(void)
+{
+    Context c("Running filters");
+
+    if (unlikely(reschedule))
+        Schedule();
+    const uint64_t began = monotonic_ns();
+
+    // Every slot's pyramid is of last frame. Starting over costs nothing
+    // until a level is asked for, which is after the slot has run.
+    vector<uint32_t>::const_iterator i;
+    for (i = order.begin(); i != order.end(); ++i)
+        funcs[*i].pyramid.reset(funcs[*i].pixels, funcs[*i].format, width, height);
+
+    // Direct filters write on the screen
+    if (SDL_MUSTLOCK(screen) && SDL_LockSurface(screen) != 0)
+        throw SDLError("Couldn't lock the screen");
+
+    vector<vector<uint32_t> >::const_iterator w;
+    for (w = waves.begin(); w != waves.end(); ++w)
+    {
+        // Filters that keep state run here, on the main thread; the rest go
+        // to the pool, unless there's nothing to run alongside them
+        TaskGroup group(pool);
+        uint32_t parallel = 0;
+        for (i = w->begin(); i != w->end(); ++i)
+            if (poolable(funcs[*i], *i))
+                ++parallel;
+        if (parallel < 2 || pool.getThreads() < 2)
+            parallel = 0;
+
+        for (i = w->begin(); i != w->end(); ++i)
+            if (parallel && poolable(funcs[*i], *i))
+                group.spawn(&tasks[*i]);
+        for (i = w->begin(); i != w->end(); ++i)
+            if (!parallel || !poolable(funcs[*i], *i))
+                RunSlot(*i);
+        group.wait();
+    }
+
+    if (SDL_MUSTLOCK(screen))
+        SDL_UnlockSurface(screen);
+
+    // The screen might not be redrawn for a few frames, so it has to catch
+    // up with all of them when it is
+    for (i = order.begin(); i != order.end(); ++i)
+        funcs[*i].pending.add(funcs[*i].dirty);
+
+    // A slot that changed how it's cut back has to start over
+    const int32_t changed = qos.frame(monotonic_ns() - began);
+    if (changed >= 0)
+        funcs[changed].behind = true;
+}
+
+void Window::RunSlot(uint32_t idx)
+{
+    const Rect all(0, 0, width, height);
+    Filter &f = funcs[idx];
+    f.dirty.clear();
+
+    if (unlikely(idx == 0))
+    {
+        if (v.frameChanged() || f.stale)
+            f.dirty.add(all);
+        f.stale = false;
+        return;
+    }
+
+    if (f.empty())
+        return;
+
+    if (f.alias != idx)
+    {
+        // Shares the frame of an identical filter that already ran
+        if (unlikely(f.stale))
+            f.dirty.add(all);
+        else
+            f.dirty.add(funcs[f.alias].dirty);
+        f.stale = false;
+        return;
+    }
+
+    const Region &in = funcs[f.src].dirty;
+
+    // Sitting this frame out to save time. Whatever came in meanwhile is
+    // caught up with on the next run.
+    if (unlikely(!f.stale && !qos.runs(idx)))
+    {
+        if (!in.empty() || (f.flags & FILTER_VOLATILE))
+        {
+            f.behind = true;
+            qos.skipped(idx);
+        }
+        return;
+    }
+
+    const uint64_t start = monotonic_ns();
+    if (unlikely(f.stale || f.behind) || (f.flags & FILTER_VOLATILE))
+    {
+        // A new frame has none of the blocks a detector would leave alone
+        if (unlikely(f.stale))
+        {
+            delete detectors[idx];
+            detectors[idx] = NULL;
+        }
+        Apply(f, 0, height);
+        Redone(idx);
+    }
+    else if (in.empty())
+        return;
+    else if (banded(f) && !qos.proxied(idx))
+    {
+        // Only the rows spanned by the changed area need to be redone, and
+        // for a stencil, the rows it reads them from
+        Rect b = in.bounds();
+        Apply(f, b.y, b.h);
+        if (f.flags & FILTER_POINTWISE)
+            f.dirty.add(in);
+        else
+        {
+            const uint32_t y0 = b.y > f.halo ? b.y - f.halo : 0;
+            f.dirty.add(Rect(0, y0, width, min(height, b.y + b.h + f.halo) - y0));
+        }
+    }
+    else
+    {
+        Apply(f, 0, height);
+        Redone(idx);
+    }
+    f.stale = f.behind = false;
+    qos.spent(idx, monotonic_ns() - start);
+}
+
+void Window::Redone(uint32_t idx)
+{
+    // A filter that detects motion only wrote the blocks it saw change
+    if (detectors[idx])
+        funcs[idx].dirty.add(detectors[idx]->changed().region());
+    else
+        funcs[idx].dirty.add(Rect(0, 0, width, height));
+}
+
+void Window::BlitTiles(void)
+{
+    Context c("Blitting tiles");
+    for (size_t idx = 0; idx < funcs.size(); ++idx)
+    {
+        Filter &f = funcs[idx];
+        // Empty tiles were cleared when the screen was set up, and hidden
+        // ones when they were hidden
+        if (!f.frame || !f.output)
+        {
+            f.pending.clear();
+            continue;
+        }
+
+        const Rect t = Tile(idx);
+        const Sint16 x = t.x, y = t.y;
+        vector<Rect>::const_iterator r;
+
+        // Already there; it just needs showing
+        if (f.direct)
+        {
+            for (r = f.pending.rects().begin(); r != f.pending.rects().end(); ++r)
+                damage.add(Rect(x + r->x, y + r->y, r->w, r->h));
+            f.pending.clear();
+            continue;
+        }
+
+        // 16-bit gray is cut down to what the screen can show
+        if (f.format == FORMAT_GRAY16 && !f.pending.empty())
+            convertFrame(FORMAT_GRAY16, f.pixels, FORMAT_GRAY8, static_cast<byte*>(f.frame->pixels), width, height);
+
+        // A scaled tile mixes neighbouring pixels, so the whole preview is
+        // redone and shown whenever anything changes
+        if (previewer.get())
+        {
+            if (f.pending.empty())
+                continue;
+            const bool gray = f.format != FORMAT_BGRA32;
+            if (!f.preview)
+                f.preview = makeFrame(tile_w, tile_h, gray ? FORMAT_GRAY8 : FORMAT_BGRA32);
+            if (gray)
+                previewer->run(static_cast<const byte*>(f.frame->pixels), static_cast<byte*>(f.preview->pixels));
+            else
+                previewer->run(static_cast<const Pixel*>(f.frame->pixels), static_cast<Pixel*>(f.preview->pixels));
+            SDL_Rect to = {x, y, 0, 0};
+            if (unlikely(SDL_BlitSurface(f.preview, NULL, screen, &to) != 0))
+                throw SDLError("Blit failed");
+            Damage(to);
+            f.pending.clear();
+            continue;
+        }
+
+        for (r = f.pending.rects().begin(); r != f.pending.rects().end(); ++r)
+        {
+            SDL_Rect from = {Sint16(r->x), Sint16(r->y), Uint16(r->w), Uint16(r->h)};
+            SDL_Rect to   = {Sint16(x + r->x), Sint16(y + r->y), 0, 0};
+            if (unlikely(SDL_BlitSurface(f.frame, &from, screen, &to) != 0))
+                throw SDLError("Blit failed");
+            Damage(to);
+        }
+        f.pending.clear();
+    }
+}
+
+Rect Window::Tile(uint32_t idx) const
+{
+    return Rect((idx % winside) * tile_w, (idx / winside) * tile_h, tile_w, tile_h);
+}
+
+void Window::Damage(const SDL_Rect &r)
+{
+    damage.add(Rect(r.x, r.y, r.w, r.h));
+}
+
+void Window::Present(void)
+{
+    // A double-buffered screen can only be flipped whole
+    if (screen->flags & SDL_DOUBLEBUF)
+        SDL_Flip(screen);
+    else if (!damage.empty())
+    {
+        vector<SDL_Rect> rs;
+        vector<Rect>::const_iterator r;
+        for (r = damage.rects().begin(); r != damage.rects().end(); ++r)
+        {
+            SDL_Rect sr = {Sint16(r->x), Sint16(r->y), Uint16(r->w), Uint16(r->h)};
+            rs.push_back(sr);
+        }
+        SDL_UpdateRects(screen, rs.size(), &rs[0]);
+    }
+    damage.clear();
 }
 
 void Window::MainLoop(void)
 {
     Context c("When running main loop");
     SDL_Event event;
-    struct timeval t1, t2 = {0,0};
     RunningAverage<uint32_t> avg(10);
+    uint64_t last = 0;
 
     while (1)
     {
-        gettimeofday(&t1, NULL);
+        const time_t second = time(NULL);
+        if (unlikely((graph || plugins) && second != graph_checked))
+        {
+            graph_checked = second;
+            // Plugins first, in case the graph wants something new
+            if (plugins)
+                this->CheckPlugins();
+            if (graph)
+                this->CheckGraph();
+        }
+
         while(unlikely(SDL_PollEvent(&event)))
         {
             Context c2("When handling an event");
@@ -107,9 +1086,11 @@ void Window::MainLoop(void)
                         case 's':
                             this->ScreenShot(screen);
                             break;
+                        case 'r':
+                            this->ToggleRecording();
+                            break;
                         case 'p':
-                            // TODO: HACK. VideoDevice needs a debugString method
-                            //cerr << *dynamic_cast<V4LDevice*>(this->v) << endl;
+                            this->ReportStats(cerr);
                             break;
                         case 'e':
                             throw GeneralError(DEBUG_HERE, "I'm just here to show what the context looks like!");
@@ -138,90 +1119,214 @@ void Window::MainLoop(void)
             }
         }
 
-        v.getFrame(static_cast<byte*>(funcs[0].frame->pixels));
+        // Processing runs as fast as the source delivers, unless it has a
+        // rate of its own
+        processing.wait();
+
+        const byte *lent = this->GrabSource();
 
+        // Repeats of the last frame aren't new, so they don't count
+        const bool fresh = v.frameChanged();
+        if (fresh)
         {
-            Context c("Running filters");
-            SDL_Rect r_tmp = {0,0,0,0};
-            SDL_Rect *r = NULL;
-            size_t idx;
-            vector<Filter>::const_iterator i;
-            for (idx = 0, i = funcs.begin(); i != funcs.end(); ++idx, ++i)
-            {
-                if (likely(idx != 0))
-                {
-                    if (i->f)
-                        i->f(static_cast<Pixel*>(funcs[i->src].frame->pixels), static_cast<Pixel*>(i->frame->pixels), v.getWidth(), v.getHeight());
-                    r_tmp = (SDL_Rect){idx % winside, idx / winside, 0, 0};
-                    r = &r_tmp;
-                    r_tmp.x *= v.getWidth();
-                    r_tmp.y *= v.getHeight();
-                }
-                if (likely(i->frame != NULL))
-                {
-                    // r == NULL the first time through, which is what i want for funcs[0], the source image
-                    if (unlikely(SDL_BlitSurface(i->frame, NULL, screen, r) != 0))
-                        throw SDLError("Blit failed");
-                }
-                else
-                {
-                    if (unlikely(SDL_FillRect(screen, r, 0) != 0))
-                        throw SDLError("FillRect failed");
-                }
-            }
+            times.grabbed   = monotonic_ns();
+            times.captured  = v.getTimestamp() ? v.getTimestamp() : times.grabbed;
+            times.filtered  = times.presented = 0;
+            to_grabbed.add(elapsed(times.captured, times.grabbed));
         }
 
-        avg.add(1/((double)(t1.tv_sec - t2.tv_sec) + (t1.tv_usec - t2.tv_usec)/1000000.0));
+        this->RunFilters();
+        this->WriteRings();
 
-        this->DrawText(stringify(avg.get()).c_str(), (SDL_Rect){0,0,0,0}, (SDL_Color){0xff,0xff,0xff,0}, (SDL_Color){0,0,0,0});
+        const uint64_t now = monotonic_ns();
+        if (fresh)
+        {
+            times.filtered = now;
+            to_filtered.add(elapsed(times.captured, now));
+        }
+        if (likely(last && now > last))
+            avg.add(1000000000ULL / (now - last));
+        last = now;
 
-        SDL_Flip(screen);
+        // The screen catches up with the newest frames at its own rate,
+        // whatever rate they're made at
+        const bool show = display.due(now);
+        if (show)
+        {
+            this->BlitTiles();
 
-        t2.tv_sec  = t1.tv_sec;
-        t2.tv_usec = t1.tv_usec;
+            // Put back whatever the last counter covered, in case this one is narrower
+            SDL_Rect under = fps_rect;
+            if (likely(funcs[0].output))
+            {
+                SDL_Surface *shown = funcs[0].preview ? funcs[0].preview : funcs[0].frame;
+                if (unlikely(SDL_BlitSurface(shown, &under, screen, &under) != 0))
+                    throw SDLError("Blit failed");
+            }
+            else if (unlikely(SDL_FillRect(screen, &under, 0) != 0))
+                throw SDLError("FillRect failed");
+            Damage(under);
+            fps_rect = this->DrawText(stringify(avg.get()).c_str(), (SDL_Rect){0,0,0,0}, (SDL_Color){0xff,0xff,0xff,0}, (SDL_Color){0,0,0,0});
+        }
 
-        if (unlikely(avg.get() < 1))
-            SDL_Delay(33);
-        else if (1000/avg.get() < 33)
-            SDL_Delay(33 - 1000/avg.get());
+        this->Record(show);
+        if (show)
+        {
+            this->Present();
+            if (times.filtered && !times.presented)
+            {
+                times.presented = monotonic_ns();
+                to_presented.add(elapsed(times.captured, times.presented));
+            }
+        }
+
+        // Nothing reads slot 0 past this point until the next frame replaces it
+        if (lent)
+            v.releaseFrame();
+
+        // A source with nothing new would have the loop spinning, so wait
+        // for the next refresh instead. Unpaced, wait for the next processing
+        // tick (processing.wait() does) or give the source a while.
+        if (!v.frameChanged())
+        {
+            if (display.getPeriod())
+                sleep_until(display.getNext());
+            else if (!processing.getPeriod())
+                sleep_until(monotonic_ns() + idle_ns);
+        }
     }
 }
 
 void Window::ScreenShot(SDL_Surface *s)
 {
     Context c("When taking a screenshot");
-    for (uint32_t i = 0; i < 50; ++i)
+    if (!shots.take(static_cast<const Pixel*>(s->pixels), s->w, s->h, s->pitch))
+        cerr << "Still writing the last few screenshots; skipping this one" << endl;
+}
+
+void Window::SetShotFormat(SnapshotFormat format)
+{
+    shots.setFormat(format);
+}
+
+void Window::SetRecording(const string &path, int32_t slot, double fps)
+{
+    if (slot >= int32_t(windows))
+        throw ArgumentError("Illegal slot to record " + stringify(slot) + " (max index is " + stringify(windows-1) + ")");
+    record_path = path;
+    record_slot = slot;
+    record_fps  = fps;
+    // A recorded slot has to keep its frame, rather than drawing it on the screen
+    reschedule = true;
+}
+
+void Window::ToggleRecording(void)
+{
+    Context c("When toggling recording");
+    if (recorder.get())
     {
-        // use open and then fdopen so I can use O_EXCL and avoid the race condition
-        int fd = open(string("shot" + stringify(i) + ".ppm").c_str(), O_CREAT|O_EXCL|O_WRONLY, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
-        if (fd < 0)
-        {
-            if(errno == EEXIST)
-                continue;
-            else
-                throw GeneralError(DEBUG_HERE, string("Could not open screenshot file: ") + strerror(errno));
-        }
-        FILE *f = fdopen(fd, "w");
-        if (!f)
-            throw GeneralError(DEBUG_HERE, string("Could not get FILE pointer to screenshot file: ") + strerror(errno));
+        recorder->stop();
+        cerr << "Recorded " << recorder->getWritten() << " frames to " << recorder->getPath()
+             << " (" << recorder->getDropped() << " dropped)" << endl;
+        recorder.reset();
+        return;
+    }
 
-        fprintf(f, "P6\n%u %u\n255\n", s->w, s->h);
+    if (record_slot < 0)
+        recorder.reset(new Recorder(record_path, screen->w, screen->h, record_fps));
+    else
+        recorder.reset(new Recorder(record_path, width, height, record_fps));
+    cerr << "Recording to " << recorder->getPath() << endl;
+}
+
+void Window::Record(bool shown)
+{
+    if (likely(!recorder.get()))
+        return;
+    if (record_slot < 0)
+    {
+        // The screen only changes when it's shown
+        if (shown)
+            recorder->push(FORMAT_BGRA32, static_cast<const byte*>(screen->pixels), screen->pitch);
+        return;
+    }
+    // An empty slot has nothing to give
+    const Filter &f = funcs[record_slot];
+    if (f.frame)
+        recorder->push(f.format, f.pixels, frameBytes(f.format, width, 1));
+}
 
-        Pixel *p = (Pixel*)s->pixels;
+void Window::Publish(uint32_t idx)
+{
+    if (idx >= windows)
+        throw ArgumentError("Illegal slot to publish " + stringify(idx) + " (max index is " + stringify(windows-1) + ")");
+    published[idx] = true;
+    reschedule = true;
+}
 
-        for (int32_t y = 0; y < s->h; ++y)
-            for (int32_t x = 0; x < s->w; ++x)
-            {
-                uint32_t off = y*s->w + x;
-                fprintf(f, "%c%c%c", R(p[off]), G(p[off]), B(p[off]));
-            }
-        fclose(f);
+void Window::ReportStats(std::ostream &os) const
+{
+    os << "Latency from capture:" << endl;
+    to_grabbed.print(os, "to taken");
+    to_filtered.print(os, "to filtered");
+    to_presented.print(os, "to shown");
+    qos.report(os);
+}
+
+void Window::SetPriority(uint32_t idx, Priority priority)
+{
+    if (idx >= windows)
+        throw ArgumentError("Illegal filter index (max index is " + stringify(windows-1) + ")");
+    if (funcs[idx].priority == priority)
         return;
+    funcs[idx].priority = priority;
+    reschedule = true;
+}
+
+void Window::SetBudget(double ms)
+{
+    if (ms < 0)
+        throw ArgumentError("A time budget can't be negative");
+    qos.setBudget(uint64_t(ms * 1e6));
+    // Anything cut back comes back in full
+    for (vector<Filter>::iterator f = funcs.begin(); f != funcs.end(); ++f)
+        f->behind = true;
+}
+
+void Window::SetPacing(double process_hz, double display_hz)
+{
+    if (process_hz < 0 || display_hz < 0)
+        throw ArgumentError("Rates can't be negative");
+    processing.setRate(process_hz);
+    display.setRate(display_hz);
+}
+
+void Window::WriteRings(void)
+{
+    Context c("When publishing frames");
+    for (uint32_t idx = 0; idx < windows; ++idx)
+    {
+        if (likely(!published[idx]))
+            continue;
+        const Filter &f = funcs[idx];
+        FrameRingWriter *&ring = rings[idx];
+        if (!f.frame)
+            continue;
+        if (unlikely(!ring || ring->getFormat() != f.format))
+        {
+            delete ring;
+            ring = NULL;
+            ring = new FrameRingWriter("/glasses-" + stringify(idx), width, height, f.format);
+            cerr << "Publishing slot " << idx << " (" << formatInfo(f.format).name << ") as " << ring->getName() << endl;
+        }
+        // Readers already have anything that didn't change
+        else if (f.dirty.empty())
+            continue;
+        ring->write(f.pixels, frameBytes(f.format, width, 1), times.captured);
     }
-    throw GeneralError(DEBUG_HERE, "Too many screenshots exist already.");
 }
 
-void Window::AddFilter(const char* name, FilterFunc f, uint32_t idx, uint32_t src)
+void Window::AddFilter(const char* name, FilterFunc f, uint32_t idx, uint32_t src, uint32_t flags)
 {
     Context c(string("When adding a filter named \"") + name + "\" at index " + stringify(uint32_t(idx)) + " with source " + stringify(uint32_t(src)));
     if (idx == 0 || idx >= windows)
@@ -231,7 +1336,216 @@ void Window::AddFilter(const char* name, FilterFunc f, uint32_t idx, uint32_t sr
     if (!funcs[src].frame)
         throw ArgumentError("Create the source before you try to use it");
 
-    funcs[idx] = Filter(f,makeFrame(v),string(name),src);
+    PlaceFilter(name, FilterInfo(f, flags), idx, src, flags);
 }
-/*}}}*/
 
+void Window::PlaceFilter(const string &name, const FilterInfo &info, uint32_t idx, uint32_t src, uint32_t flags)
+{
+    // Anything sharing the old frame keeps a copy of it
+    for (uint32_t i = 0; i < funcs.size(); ++i)
+        if (i != idx && funcs[i].alias == idx)
+            Unshare(i);
+    FreeFrame(funcs[idx]);
+    delete detectors[idx];
+    detectors[idx] = NULL;
+
+    // Schedule picks the format; start out in BGRA like f itself
+    const bool output = funcs[idx].output;
+    funcs[idx] = Filter(info.f,name,src,flags);
+    funcs[idx].configured = info.configured;
+    info.configure(FilterParams(), funcs[idx].config);
+    Allocate(funcs[idx], FORMAT_BGRA32);
+    funcs[idx].alias  = idx;
+    funcs[idx].output = output;
+    reschedule = true;
+}
+
+void Window::RemoveFilter(uint32_t idx)
+{
+    Context c("When removing filter " + stringify(idx));
+    if (idx == 0 || idx >= windows)
+        throw ArgumentError("Illegal filter index (range is 1:" + stringify(windows-1) + " inclusive)");
+    for (uint32_t i = 1; i < funcs.size(); ++i)
+        if (!funcs[i].empty() && funcs[i].src == idx && i != idx)
+            throw ArgumentError("Filter " + stringify(i) + " (" + funcs[i].name + ") uses it as a source");
+
+    ClearSlot(idx);
+}
+
+void Window::ClearSlot(uint32_t idx)
+{
+    if (!funcs[idx].frame)
+        return;
+
+    for (uint32_t i = 0; i < funcs.size(); ++i)
+        if (i != idx && funcs[i].alias == idx)
+            Unshare(i);
+    FreeFrame(funcs[idx]);
+    delete detectors[idx];
+    detectors[idx] = NULL;
+
+    funcs[idx] = Filter(0, "None", -1);
+    funcs[idx].alias = idx;
+
+    const Rect t = Tile(idx);
+    SDL_Rect r = {Sint16(t.x), Sint16(t.y), Uint16(t.w), Uint16(t.h)};
+    if (SDL_FillRect(screen, &r, 0) != 0)
+        throw SDLError("FillRect failed");
+    Damage(r);
+    reschedule = true;
+}
+
+void Window::SetOutput(uint32_t idx, bool output)
+{
+    Context c("When setting the output flag on filter " + stringify(idx));
+    if (idx >= windows)
+        throw ArgumentError("Illegal filter index (max index is " + stringify(windows-1) + ")");
+
+    Filter &f = funcs[idx];
+    if (f.output == output)
+        return;
+    f.output = output;
+    // A tile coming back needs drawing in full; one going away needs clearing
+    f.stale = true;
+    if (!output)
+    {
+        const Rect t = Tile(idx);
+        SDL_Rect r = {Sint16(t.x), Sint16(t.y), Uint16(t.w), Uint16(t.h)};
+        if (SDL_FillRect(screen, &r, 0) != 0)
+            throw SDLError("FillRect failed");
+        Damage(r);
+    }
+    reschedule = true;
+}
+
+void Window::SetGraph(const vector<GraphNode> &nodes)
+{
+    Context c("When setting up the filter graph");
+
+    // Check everything first, so a bad graph leaves the old one running
+    vector<const GraphNode*> slots(windows, static_cast<const GraphNode*>(NULL));
+    vector<GraphNode>::const_iterator n;
+    for (n = nodes.begin(); n != nodes.end(); ++n)
+    {
+        if (n->slot == 0 || n->slot >= windows)
+            throw GraphError("Illegal filter index " + stringify(n->slot) + " (range is 1:" + stringify(windows-1) + " inclusive)");
+        if (slots[n->slot])
+            throw GraphError("Slot " + stringify(n->slot) + " is used twice");
+        slots[n->slot] = &*n;
+    }
+    for (n = nodes.begin(); n != nodes.end(); ++n)
+        if (n->src == n->slot || n->src >= windows || (n->src != 0 && !slots[n->src]))
+            throw GraphError("Slot " + stringify(n->slot) + " reads from slot " + stringify(n->src) + ", which has no filter");
+
+    // The graph fits, so each line's settings can be made. They're the
+    // line's own, and nothing running has changed yet, so a value a filter
+    // won't take leaves the old graph exactly as it was.
+    vector<vector<byte> > configs(windows);
+    for (n = nodes.begin(); n != nodes.end(); ++n)
+    {
+        const FilterParams rejected = n->info.configure(n->params, configs[n->slot]);
+        if (!rejected.empty())
+            throw GraphError("Slot " + stringify(n->slot) + " (" + n->name + ") won't take " + rejected[0].first + "=" + rejected[0].second);
+    }
+
+    for (uint32_t idx = 1; idx < windows; ++idx)
+    {
+        const GraphNode *g = slots[idx];
+        if (!g)
+        {
+            ClearSlot(idx);
+            continue;
+        }
+
+        const Filter &f = funcs[idx];
+        if (!f.frame || f.name != g->name || !placed(g->info, f) || f.src != g->src || f.flags != g->info.flags)
+            PlaceFilter(g->name, g->info, idx, g->src, g->info.flags);
+        else if (f.params != g->params)
+        {
+            // Rerun with the new settings, which may also end (or start)
+            // sharing a frame with another line
+            funcs[idx].stale = true;
+            reschedule = true;
+        }
+        funcs[idx].params = g->params;
+        funcs[idx].config.swap(configs[idx]);
+        funcs[idx].forced  = g->forced;
+        funcs[idx].cleared = g->cleared;
+        SetOutput(idx, g->output);
+        SetPriority(idx, g->priority);
+    }
+}
+
+void Window::WatchGraph(GraphFile *g)
+{
+    graph = g;
+}
+
+void Window::WatchPlugins(PluginLoader *p)
+{
+    plugins = p;
+}
+
+void Window::CheckPlugins(void)
+{
+    try {
+        if (!plugins->scan())
+            return;
+    } catch (const Exception &e) {
+        cerr << "Couldn't scan for plugins: " << e.message() << endl;
+        return;
+    }
+
+    // The old versions get unloaded on the next scan, so stop using them now
+    for (uint32_t idx = 1; idx < funcs.size(); ++idx)
+    {
+        Filter &f = funcs[idx];
+        if (f.empty() || !FilterRegistry::get().has(f.name))
+            continue;
+        const FilterInfo &fresh = FilterRegistry::get().find(f.name);
+        if (placed(fresh, f))
+            continue;
+
+        // The new version's properties decide how it's run (on the screen,
+        // in bands, off the main thread), and it might lay its settings out
+        // differently, so it goes in afresh with what the graph gave it
+        const string name = f.name;
+        const FilterParams params = f.params;
+        const Priority priority = f.priority;
+        const uint32_t forced = f.forced, cleared = f.cleared;
+        PlaceFilter(name, fresh, idx, f.src, (fresh.flags | forced) & ~cleared);
+        f.params   = params;
+        f.priority = priority;
+        f.forced   = forced;
+        f.cleared  = cleared;
+        Reconfigure(f);
+    }
+}
+
+void Window::Reconfigure(Filter &f)
+{
+    if (f.empty() || !FilterRegistry::get().has(f.name))
+        return;
+    const FilterInfo &info = FilterRegistry::get().find(f.name);
+    if (!placed(info, f))
+        return;
+    const FilterParams rejected = info.configure(f.params, f.config);
+    FilterParams::const_iterator p;
+    for (p = rejected.begin(); p != rejected.end(); ++p)
+        cerr << "Filter " << f.name << " won't take " << p->first << "=" << p->second << " any more" << endl;
+}
+
+void Window::CheckGraph(void)
+{
+    if (!graph->modified())
+        return;
+
+    try {
+        graph->load();
+        SetGraph(graph->getNodes());
+        cerr << "Reloaded " << graph->getPath() << endl;
+    } catch (const Exception &e) {
+        cerr << "Not reloading " << graph->getPath() << ": " << e.message() << endl;
+    }
+}
+/*}}}*/
@@ -2,28 +2,112 @@
 #define WINDOW_H
 
 #include <vector>
+#include <memory>
 
 // For SDL
 #include <SDL.h>
 #include <SDL_ttf.h>
 
 #include "global.h"
+#include "region.h"
+#include "registry.h"
+#include "graph.h"
+#include "pluginloader.h"
+#include "pyramid.h"
+#include "motion.h"
+#include "snapshot.h"
+#include "recorder.h"
+#include "qos.h"
+#include "utils/pacer.h"
+#include "utils/histogram.h"
+#include "utils/threadpool.h"
+#include "video/framering.h"
 #include "video/videodevice.h"
+#include "video/resample.h"
 using std::vector;
 using std::string;
 
-// Characterizes a filter
-typedef void (*FilterFunc)(const Pixel *in, Pixel *out, const uint32_t width, const uint32_t height);
 struct Filter {
-    Filter(FilterFunc f, SDL_Surface* frame, string name, uint32_t src): f(f), frame(frame), name(name), src(src) {};
+    Filter(FilterFunc f, string name, uint32_t src, uint32_t flags = 0):
+        f(f), configured(0), kernel(0), rows(0), kernel_rows(0), halo(0), in(FORMAT_BGRA32), format(FORMAT_BGRA32), frame(NULL), preview(NULL), buffer(NULL), pixels(NULL),
+        name(name), src(src), flags(flags), forced(0), cleared(0), stale(true), behind(false), output(true), needed(false), direct(false), alias(0),
+        priority(PRIORITY_NORMAL) {};
     // Processing function
     FilterFunc f;
-    // Buffer to draw in (persists)
+    // ... or, for a filter with parameters, the one that takes the slot's
+    // settings (config) as well
+    ConfigFilterFunc configured;
+    // The version of f that runs, if not f itself, and the format it reads
+    KernelFunc kernel;
+    // Whichever of f and kernel runs, for a band of rows (NULL if it has
+    // to see the whole frame, or is point-wise and doesn't need one), and
+    // how many rows beyond a band it reads
+    RowsFunc rows;
+    KernelRowsFunc kernel_rows;
+    uint32_t halo;
+    PixelFormat in;
+    // Format of pixels: BGRA32, GRAY8 or GRAY16
+    PixelFormat format;
+    // Surface for the tile on the screen. For BGRA and GRAY8 it shows pixels
+    // directly; GRAY16 gets cut down to 8 bits in a buffer of its own.
     SDL_Surface *frame;
-    // Name of filter (will be used later for config file filter chains)
+    // frame scaled to the tile size, when tiles aren't the processing size
+    SDL_Surface *preview;
+    // The pixels this filter owns. NULL while it shows another filter's pixels.
+    byte *buffer;
+    // The frame (persists): buffer, another filter's buffer, or for the
+    // source slot, a buffer the VideoDevice lent
+    byte *pixels;
+    // The source converted to in, when it comes in another format
+    vector<byte> input;
+    // Smaller copies of pixels, for the filters that read this one. Only the
+    // alias's is used.
+    Pyramid pyramid;
+    // Name of filter (its name in the FilterRegistry, for graph files)
     string name;
+    // The filter-specific parameters the graph gave it, to give it again
+    // when it's reloaded, and the settings made from them
+    FilterParams params;
+    vector<byte> config;
     // filter to use as the source
     uint32_t src;
+    // FILTER_* properties, and those the graph line turned on and off, to
+    // keep when the filter is reloaded
+    uint32_t flags, forced, cleared;
+    // Parts of frame that changed this time through the loop
+    Region dirty;
+    // Parts of frame that changed since its tile was last drawn
+    Region pending;
+    // frame doesn't reflect the source yet (new filter)
+    bool stale;
+    // The filter sat out frames to save time, so its next run redoes the
+    // whole frame
+    bool behind;
+    // Something outside the graph wants frame (a tile on the screen, etc)
+    bool output;
+    // An output depends on this filter, so it gets run
+    bool needed;
+    // The filter writes straight into its tile on the screen, row by row,
+    // and pixels isn't kept up. Only for point-wise filters with BGRA
+    // output that nothing else reads.
+    bool direct;
+    // The filter that actually computes this one's frame. Itself, unless an
+    // identical filter (same function, flags and source) got there first.
+    uint32_t alias;
+    // What goes first when frames run late, and the filter's output when
+    // it's cut back to a half-size input
+    Priority priority;
+    vector<byte> proxy;
+
+    /** Whether the slot has no filter in it */
+    inline bool empty(void) const {return !f && !configured;};
+};
+
+// When the newest source frame got through each stage (monotonic_ns; 0 is
+// not yet)
+struct FrameTimes
+{
+    uint64_t captured, grabbed, filtered, presented;
 };
 
 class Window
@@ -33,8 +117,14 @@ class Window
          * Create the main window.
          * @param v         The VideoDevice to use as the primary source
          * @param windows   The number of empty frames to create.
+         * @param width     Size the filters work at. The source is scaled
+         * @param height    to it; 0 means the source's own size.
+         * @param tile_w    Size of each tile on the screen. Frames are
+         * @param tile_h    scaled to it; 0 means the processing size.
+         * @param method    How to scale the source
          */
-        Window(VideoDevice &v, uint32_t windows);
+        Window(VideoDevice &v, uint32_t windows, uint32_t width = 0, uint32_t height = 0,
+                uint32_t tile_w = 0, uint32_t tile_h = 0, ResampleMethod method = RESAMPLE_AREA);
         ~Window(void);
 
         /** Run the main loop */
@@ -47,8 +137,49 @@ class Window
          * @param idx       Filter ID. This should go away, and the name
          *                  should be used instead
          * @param src       Source ID. Sources are the inputs for the filters.
+         * @param flags     FILTER_* properties of f
+         */
+        void AddFilter(const char *name, FilterFunc f, uint32_t idx, uint32_t src = 0, uint32_t flags = 0);
+
+        /**
+         * Remove a filter, leaving its slot empty
+         * @param idx       Filter ID. Nothing may be using it as a source.
+         */
+        void RemoveFilter(uint32_t idx);
+
+        /**
+         * Replace all the filters with the ones in a graph description.
+         * Slots whose filter didn't change keep running undisturbed, and the
+         * source is left alone.
+         * @param nodes     The new graph. If it doesn't fit, GraphError is
+         *                  thrown and the old graph stays.
          */
-        void AddFilter(const char *name, FilterFunc f, uint32_t idx, uint32_t src = 0);
+        void SetGraph(const vector<GraphNode> &nodes);
+
+        /**
+         * Reload a graph file whenever it changes. Broken edits are reported
+         * and otherwise ignored.
+         * @param g         The file, which must outlive the window. NULL
+         *                  stops watching.
+         */
+        void WatchGraph(GraphFile *g);
+
+        /**
+         * Rescan a plugin directory every so often, and switch filters over
+         * to new versions of plugins as they show up.
+         * @param p         The loader, which must outlive the window. NULL
+         *                  stops watching.
+         */
+        void WatchPlugins(PluginLoader *p);
+
+        /**
+         * Mark a slot as an output or not. Only outputs get a tile on the
+         * screen, and only outputs and the filters they draw from are run.
+         * Every slot starts out as an output.
+         * @param idx       Filter ID
+         * @param output    Whether something wants the slot's frame
+         */
+        void SetOutput(uint32_t idx, bool output = true);
 
         /**
          * Helper function to draw arbitrary text
@@ -56,22 +187,263 @@ class Window
          * @param loc   Location and size of text
          * @param fg    Foreground color
          * @param bg    Background color
+         * @return      The area of the screen that was drawn on
          * @depreciated in favor of the text overlay. Eventually.
          */
-        void DrawText(const char *text, SDL_Rect loc, SDL_Color fg, SDL_Color bg);
+        SDL_Rect DrawText(const char *text, SDL_Rect loc, SDL_Color fg, SDL_Color bg);
 
         /**
-         * Take a screenshot. Writes a PPM to a file shot%i.ppm
-         * @param s Surface to take a screenshot of
+         * Take a screenshot. The surface is copied, and written to the next
+         * shot%i.ppm (or .png) in the background.
+         * @param s Surface to take a screenshot of (32-bit BGRA)
          */
         void ScreenShot(SDL_Surface *s);
+
+        /** Pick what screenshots are written as */
+        void SetShotFormat(SnapshotFormat format);
+
+        /**
+         * Say what the r key records, and where to
+         * @param path  file name; see Recorder
+         * @param slot  the slot whose frame to record, or -1 for the screen
+         * @param fps   frame rate to note in the file
+         */
+        void SetRecording(const string &path, int32_t slot = -1, double fps = 30);
+
+        /** Start recording, or stop and say how it went */
+        void ToggleRecording(void);
+
+        /**
+         * Publish a slot's frames to other processes, through a shared
+         * memory ring (see FrameRingWriter) called /glasses-<idx>. The slot
+         * runs whether or not it has a tile.
+         * @param idx       Filter ID
+         */
+        void Publish(uint32_t idx);
+
+        /**
+         * Set how often frames are processed and the screen redrawn. The
+         * screen shows the newest frame processed by each redraw.
+         * @param process_hz    frames processed per second, or 0 for as
+         *                      fast as the source gives them
+         * @param display_hz    screen redraws per second, or 0 for every
+         *                      frame processed
+         */
+        void SetPacing(double process_hz, double display_hz);
+
+        /**
+         * Mark how much a slot matters when the filters can't all keep up.
+         * Whatever a slot reads from matters at least as much as it does.
+         * @param idx       Filter ID
+         * @param priority  PRIORITY_CRITICAL slots are never cut back
+         */
+        void SetPriority(uint32_t idx, Priority priority);
+
+        /**
+         * Give the filters a time budget per frame. While they take longer,
+         * the least important slots are run at half size, then on fewer
+         * frames, then not at all, until they fit; they come back as time
+         * allows. See LoadShedder.
+         * @param ms    milliseconds per frame, or 0 to run everything always
+         */
+        void SetBudget(double ms);
+
+        /**
+         * Say how long frames took from capture to each stage so far, and
+         * what the filters cost and which of them are cut back
+         */
+        void ReportStats(std::ostream &os) const;
     private:
+        /** AddFilter without the checks */
+        void PlaceFilter(const string &name, const FilterInfo &info, uint32_t idx, uint32_t src, uint32_t flags);
+
+        /** RemoveFilter without the checks */
+        void ClearSlot(uint32_t idx);
+
+        /** Reload the watched graph file, if it changed */
+        void CheckGraph(void);
+
+        /** Rescan for plugins, and look up any filters that were reloaded */
+        void CheckPlugins(void);
+
+        /** Remake a slot's settings from its parameters, ignoring any it won't take */
+        void Reconfigure(Filter &f);
+
+        /** Work out which filters the outputs need, sources first */
+        void Schedule(void);
+
+        /** Decide which filters can draw straight onto the screen */
+        void ChooseDirect(void);
+
+        /** Tell the load shedder what runs, and how much each slot matters */
+        void Prioritize(void);
+
+        /** Group the order into waves of filters that can run at once */
+        void Stage(void);
+
+        void Visit(uint32_t idx, vector<byte> &state);
+
+        /** Pick which version of idx's filter to run, from its source's format */
+        void Choose(uint32_t idx);
+
+        /** Give a slot a new frame (and surface) in another format */
+        void Reformat(uint32_t idx, PixelFormat format);
+        void Allocate(Filter &f, PixelFormat format);
+        void FreeFrame(Filter &f);
+
+        /** Point a slot (and its surface, if it can show them) at some pixels */
+        void SetPixels(Filter &f, byte *pixels);
+
+        /**
+         * Run a filter where rows [y, y+rows) of its input changed (and so,
+         * for a stencil, on the rows its halo reaches too), converting the
+         * input if needed. Big enough frames are split into bands that run
+         * on the task pool.
+         */
+        void Apply(Filter &f, uint32_t y, uint32_t rows);
+
+        /** How many bands to split that many rows of f into (1: don't split) */
+        uint32_t Bands(const Filter &f, uint32_t rows) const;
+
+        /** Convert rows [y0, y1) of f's source to the format f reads */
+        void Convert(Filter &f, uint32_t y0, uint32_t y1);
+
+        /** Run f on rows [y0, y1) of its (converted) input */
+        void RunRows(Filter &f, uint32_t y0, uint32_t y1);
+
+        /** Drop idx's pixels and show the frame of the identical filter canon instead */
+        void Share(uint32_t idx, uint32_t canon);
+
+        /** Give idx its own pixels back, starting from a copy of the shared ones */
+        void Unshare(uint32_t idx);
+
+        /**
+         * Pick slot 0's format: 8-bit gray if every filter reading it takes
+         * gray, and no colour that's shown, published or recorded is lost;
+         * else BGRA
+         */
+        void ChooseSource(void);
+
+        /** Scale the device's frame into slot 0, converting the smaller side */
+        void ScaleSource(const byte *frame);
+
+        /**
+         * Get the next frame into slot 0, converted to its format and scaled
+         * to the processing size if the device delivers something else and
+         * anything needs it
+         * @return the frame the device lent, to be released once it's done
+         *         with, or NULL
+         */
+        const byte* GrabSource(void);
+
+        /** Run the filters whose input changed, and work out what they dirtied */
+        void RunFilters(void);
+
+        /** RunFilters for one slot; its wave's sources have already run */
+        void RunSlot(uint32_t idx);
+
+        /** Mark what a run of idx's filter on the whole frame changed */
+        void Redone(uint32_t idx);
+
+        /** Copy the dirty parts of each filter's frame to its tile on the screen */
+        void BlitTiles(void);
+
+        /** Where idx's tile is on the screen */
+        Rect Tile(uint32_t idx) const;
+
+        /** Note that part of the screen was drawn on, so it gets shown */
+        void Damage(const SDL_Rect &r);
+
+        /** Show what was drawn this time round */
+        void Present(void);
+
+        /**
+         * Queue this frame to the recorder, if there is one
+         * @param shown whether the screen was redrawn this time round
+         */
+        void Record(bool shown);
+
+        /** Write the published slots that changed to their rings */
+        void WriteRings(void);
+
         SDL_Surface *screen;
         VideoDevice &v;
         // The number of total windows, and the number of windows on a side
         uint32_t windows, winside;
+        // Processing size, and the size of a tile on the screen
+        uint32_t width, height, tile_w, tile_h;
+        // Source to processing size, and processing to tile size. NULL
+        // when the sizes are the same. YUV sources also get one for their
+        // chroma planes.
+        std::auto_ptr<Resampler> scaler, chroma, previewer;
+        // The device's frame at its own size in what the scalers take (gray,
+        // YUV planes or BGRA), and scaled but not yet converted to slot 0's format
+        vector<byte> native, scaled;
         vector<Filter> funcs;
+        // The device's frame, when it can't go in slot 0 as it is and isn't lent
+        vector<byte> raw;
+        // The filters that need running, in dependency order, and the same
+        // filters in waves: each wave only reads what earlier ones wrote (or
+        // what later ones wrote last frame), so a wave's filters can run on
+        // the task pool all at once
+        vector<uint32_t> order;
+        vector<vector<uint32_t> > waves;
+        bool reschedule;
         TTF_Font *font;
+        // Where the fps counter was last drawn
+        SDL_Rect fps_rect;
+        // Parts of the screen drawn on since they were last shown
+        Region damage;
+        // When frames get processed (as fast as the source gives them, by
+        // default), and when the screen gets redrawn
+        novas0x2a::Pacer processing, display;
+        // The newest source frame's progress, and how long frames have
+        // taken from capture to being taken, filtered and shown
+        FrameTimes times;
+        novas0x2a::LatencyHistogram to_grabbed, to_filtered, to_presented;
+        // Keeps the filters in their time budget, and scales cut back slots'
+        // half-size output back up (a resampler per slot, as they can run at
+        // the same time)
+        LoadShedder qos;
+        vector<Resampler*> upscalers;
+        // Block motion detectors, for the slots whose filters use one
+        vector<MotionDetector*> detectors;
+        // Runs each wave's filters, a task per slot
+        struct SlotTask : public novas0x2a::Task
+        {
+            Window *w;
+            uint32_t idx;
+            void run(void) {w->RunSlot(idx);};
+        };
+        // Converts, then runs, a band of a filter's rows
+        struct BandTask : public novas0x2a::Task
+        {
+            Window *w;
+            Filter *f;
+            uint32_t convert0, convert1, run0, run1;
+            void run(void)
+            {
+                w->Convert(*f, convert0, convert1);
+                w->RunRows(*f, run0, run1);
+            };
+        };
+        novas0x2a::TaskPool &pool;
+        vector<SlotTask> tasks;
+        SnapshotWriter shots;
+        // What r records, and the recording when there is one
+        string record_path;
+        int32_t record_slot;
+        double record_fps;
+        std::auto_ptr<Recorder> recorder;
+        // Slots published to other processes, and their rings (made with
+        // the first frame, and again whenever the slot's format changes)
+        vector<bool> published;
+        vector<FrameRingWriter*> rings;
+        // Graph file and plugins to reload when they change, and when they
+        // were last checked
+        GraphFile *graph;
+        PluginLoader *plugins;
+        time_t graph_checked;
 };
 
 #endif